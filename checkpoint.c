@@ -0,0 +1,311 @@
+#include <errno.h>
+
+#include "scheduler.h"
+
+/*
+Checkpoint file format (text, one record per line):
+    checkpoint <version> <schedule_type> <num_threads> <threads_remaining> <global_time> <io_end_time>
+    cfs <cfs_current> <cfs_min_vruntime> <cfs_load>
+    switch <cpu_last_tid> <switch_tid> <switch_left> <switches> <switch_ticks> <cache_ticks> <cpu_run_ticks>
+    predict <predictions> <prediction_abs_error> <prediction_error> <prediction_max_error>
+    semaphore <S>                                   (one line per semaphore)
+    queue <n>, then n lines of <tid> <priority1> <priority2>
+                                                    (cpu, io, mlfq levels, semaphore queues, cfs tree)
+    task <tid> <state> ...                          (one line per thread, see save_task)
+
+threads_waiting and the timing wheel are not saved: threads waiting for their operation's time
+call it again on resume.
+*/
+#define CHECKPOINT_VERSION 3
+
+static void save_queue(FILE *fp, struct priority_queue *queue)
+{
+    int count = 0;
+    for (struct priority_node *node = queue->head; node != NULL; node = node->next)
+    {
+        count++;
+    }
+    fprintf(fp, "queue %d\n", count);
+    for (struct priority_node *node = queue->head; node != NULL; node = node->next)
+    {
+        fprintf(fp, "%d %.9g %.9g\n", node->tid, node->priority1, node->priority2);
+    }
+}
+
+static int load_queue(FILE *fp, struct priority_queue *queue)
+{
+    int count;
+    if (fscanf(fp, " queue %d", &count) != 1)
+    {
+        return -EINVAL;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        int tid;
+        float priority1, priority2;
+        if (fscanf(fp, "%d %f %f", &tid, &priority1, &priority2) != 3 || tid < 0 || tid >= num_threads)
+        {
+            return -EINVAL;
+        }
+        // Nodes are saved in order and push keeps ties in insertion order
+        push(queue, tid, priority1, priority2);
+    }
+    return 0;
+}
+
+// Write the CFS tree in order, in the same format as a queue
+static void save_rb_nodes(FILE *fp, struct rb_node *node)
+{
+    if (node == NULL)
+    {
+        return;
+    }
+    save_rb_nodes(fp, node->left);
+    fprintf(fp, "%d %ld 0\n", node->tid, node->key);
+    save_rb_nodes(fp, node->right);
+}
+
+static int load_rb_tree(FILE *fp, struct rb_tree *tree)
+{
+    int count;
+    if (fscanf(fp, " queue %d", &count) != 1)
+    {
+        return -EINVAL;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        int tid, unused;
+        long key;
+        if (fscanf(fp, "%d %ld %d", &tid, &key, &unused) != 3 || tid < 0 || tid >= num_threads)
+        {
+            return -EINVAL;
+        }
+        rb_insert(tree, tid, key);
+    }
+    return 0;
+}
+
+static bool in_queue(struct priority_queue *queue, int tid, float *priority1)
+{
+    for (struct priority_node *node = queue->head; node != NULL; node = node->next)
+    {
+        if (node->tid == tid)
+        {
+            if (priority1 != NULL)
+            {
+                *priority1 = node->priority1;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+static void save_task(FILE *fp, int tid)
+{
+    // Work out where the thread is blocked
+    enum resume_state state = RESUME_QUEUED;
+    float time = -1.0;
+    if (ended[tid])
+    {
+        state = RESUME_ENDED;
+    }
+    else if (in_queue(&threads_waiting, tid, &time) || wheel_find(&wakeup_wheel, tid, &time))
+    {
+        state = RESUME_WAITING;
+    }
+    else
+    {
+        for (int i = 0; i < MAX_NUM_SEM; i++)
+        {
+            if (in_queue(&semaphores[i].queue, tid, NULL))
+            {
+                state = RESUME_SEMAPHORE;
+            }
+        }
+    }
+
+    struct deadline_stats *stats = &deadline_stats[tid];
+    fprintf(fp, "task %d %d %d %d %.9g %.9g %d %d %d %d %d %ld %d %d %.9g %.9g %d %.9g %d",
+            tid, state, op_cursor[tid], cpu_remaining[tid], time,
+            cpu_arrival_times[tid], io_durations[tid],
+            consecutive_run_time[tid], last_run_time[tid], current_level[tid],
+            cfs_weight[tid], cfs_vruntime[tid], cfs_slice[tid], cfs_slice_run[tid],
+            job_release[tid], job_deadline[tid], last_dispatch[tid], burst_estimate[tid], burst_run[tid]);
+    fprintf(fp, " %.9g %d %d %d %d %.9g %.9g %.9g",
+            stats->period, stats->burst, stats->wcet, stats->jobs, stats->misses,
+            stats->lateness_sum, stats->lateness_max, stats->density);
+    for (int b = 0; b < DEADLINE_BUCKETS; b++)
+    {
+        fprintf(fp, " %d", stats->lateness_hist[b]);
+    }
+    fprintf(fp, "\n");
+}
+
+static int load_task(FILE *fp)
+{
+    int tid, state;
+    if (fscanf(fp, " task %d %d", &tid, &state) != 2 || tid < 0 || tid >= num_threads)
+    {
+        return -EINVAL;
+    }
+
+    struct deadline_stats *stats = &deadline_stats[tid];
+    int read = fscanf(fp, "%d %d %f %f %d %d %d %d %d %ld %d %d %f %f %d %f %d",
+                      &op_cursor[tid], &cpu_remaining[tid], &resume_time[tid],
+                      &cpu_arrival_times[tid], &io_durations[tid],
+                      &consecutive_run_time[tid], &last_run_time[tid], &current_level[tid],
+                      &cfs_weight[tid], &cfs_vruntime[tid], &cfs_slice[tid], &cfs_slice_run[tid],
+                      &job_release[tid], &job_deadline[tid], &last_dispatch[tid],
+                      &burst_estimate[tid], &burst_run[tid]);
+    read += fscanf(fp, "%f %d %d %d %d %f %f %f",
+                   &stats->period, &stats->burst, &stats->wcet, &stats->jobs, &stats->misses,
+                   &stats->lateness_sum, &stats->lateness_max, &stats->density);
+    for (int b = 0; b < DEADLINE_BUCKETS; b++)
+    {
+        read += fscanf(fp, "%d", &stats->lateness_hist[b]);
+    }
+    if (read != 25 + DEADLINE_BUCKETS)
+    {
+        return -EINVAL;
+    }
+
+    resume_state[tid] = state;
+    ended[tid] = state == RESUME_ENDED;
+    return 0;
+}
+
+// Save the whole simulation state; only called by global_clock while every thread is blocked
+int save_checkpoint(const char *file_name)
+{
+    FILE *fp = fopen(file_name, "w");
+    if (fp == NULL)
+    {
+        perror("fopen() error");
+        return -errno;
+    }
+
+    fprintf(fp, "checkpoint %d %d %d %d %d %d\n", CHECKPOINT_VERSION, schedule_type,
+            num_threads, threads_remaining, global_time, io_end_time);
+    fprintf(fp, "cfs %d %ld %ld\n", cfs_current, cfs_min_vruntime, cfs_load);
+    fprintf(fp, "switch %d %d %d %ld %ld %ld %ld\n", cpu_last_tid, switch_tid, switch_left,
+            switches, switch_ticks, cache_ticks, cpu_run_ticks);
+    fprintf(fp, "predict %ld %.17g %.17g %.9g\n", predictions, prediction_abs_error, prediction_error,
+            prediction_max_error);
+    for (int i = 0; i < MAX_NUM_SEM; i++)
+    {
+        fprintf(fp, "semaphore %d\n", semaphores[i].S);
+    }
+
+    save_queue(fp, &cpu_queue);
+    save_queue(fp, &io_queue);
+    for (int i = 0; i < 5; i++)
+    {
+        save_queue(fp, &mlfq_queues[i]);
+    }
+    for (int i = 0; i < MAX_NUM_SEM; i++)
+    {
+        save_queue(fp, &semaphores[i].queue);
+    }
+    fprintf(fp, "queue %d\n", cfs_tree.count);
+    save_rb_nodes(fp, cfs_tree.root);
+
+    for (int i = 0; i < num_threads; i++)
+    {
+        save_task(fp, i);
+    }
+
+    if (fclose(fp) != 0)
+    {
+        perror("fclose() error");
+        return -errno;
+    }
+    return 0;
+}
+
+// Restore the state saved by save_checkpoint into a freshly initialized scheduler
+int load_checkpoint(const char *file_name)
+{
+    FILE *fp = fopen(file_name, "r");
+    if (fp == NULL)
+    {
+        perror("fopen() error");
+        return -errno;
+    }
+
+    int version, type, count;
+    int ret = -EINVAL;
+    if (fscanf(fp, "checkpoint %d %d %d %d %d %d", &version, &type, &count,
+               &threads_remaining, &global_time, &io_end_time) != 6)
+    {
+        fprintf(stderr, "%s: %s is not a checkpoint\n", __func__, file_name);
+        goto out;
+    }
+    if (version != CHECKPOINT_VERSION || type != schedule_type || count != num_threads)
+    {
+        fprintf(stderr, "%s: checkpoint was saved with scheduler type %d and %d threads\n", __func__, type, count);
+        goto out;
+    }
+    // Threads waiting for a later time are added again as they resume
+    init_wheel(&wakeup_wheel, global_time);
+    if (fscanf(fp, " cfs %d %ld %ld", &cfs_current, &cfs_min_vruntime, &cfs_load) != 3)
+    {
+        goto corrupt;
+    }
+    if (fscanf(fp, " switch %d %d %d %ld %ld %ld %ld", &cpu_last_tid, &switch_tid, &switch_left,
+               &switches, &switch_ticks, &cache_ticks, &cpu_run_ticks) != 7)
+    {
+        goto corrupt;
+    }
+    if (fscanf(fp, " predict %ld %lf %lf %f", &predictions, &prediction_abs_error, &prediction_error,
+               &prediction_max_error) != 4)
+    {
+        goto corrupt;
+    }
+    for (int i = 0; i < MAX_NUM_SEM; i++)
+    {
+        if (fscanf(fp, " semaphore %d", &semaphores[i].S) != 1)
+        {
+            goto corrupt;
+        }
+    }
+
+    if (load_queue(fp, &cpu_queue) || load_queue(fp, &io_queue))
+    {
+        goto corrupt;
+    }
+    for (int i = 0; i < 5; i++)
+    {
+        if (load_queue(fp, &mlfq_queues[i]))
+        {
+            goto corrupt;
+        }
+    }
+    for (int i = 0; i < MAX_NUM_SEM; i++)
+    {
+        if (load_queue(fp, &semaphores[i].queue))
+        {
+            goto corrupt;
+        }
+    }
+    if (load_rb_tree(fp, &cfs_tree))
+    {
+        goto corrupt;
+    }
+
+    for (int i = 0; i < num_threads; i++)
+    {
+        if (load_task(fp))
+        {
+            goto corrupt;
+        }
+    }
+    ret = 0;
+    goto out;
+
+corrupt:
+    fprintf(stderr, "%s: %s is corrupt\n", __func__, file_name);
+out:
+    fclose(fp);
+    return ret;
+}
@@ -0,0 +1,260 @@
+#ifdef COROUTINE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+
+#include "coroutine.h"
+
+struct coroutine {
+    ucontext_t context;
+    void *(*func)(void *);
+    void *arg;
+    char *stack;
+    bool done;
+    bool detached;             // Freed when it ends instead of by co_join
+    struct coroutine *next;    // Link in the run queue or in a mutex or cond wait list
+};
+
+static ucontext_t carrier_context;  // Context of the thread running the coroutines
+static struct coroutine *current;   // NULL while the carrier itself runs
+static struct coroutine *run_head;  // Coroutines ready to run, in order
+static struct coroutine *run_tail;
+static char *free_stacks;           // Unused stacks, linked through their first bytes
+static int guarded_stacks;          // Stacks given a guard page so far
+
+static void enqueue(struct coroutine **head, struct coroutine **tail, struct coroutine *co)
+{
+    co->next = NULL;
+    if (*tail == NULL)
+    {
+        *head = co;
+    }
+    else
+    {
+        (*tail)->next = co;
+    }
+    *tail = co;
+}
+
+static struct coroutine *dequeue(struct coroutine **head, struct coroutine **tail)
+{
+    struct coroutine *co = *head;
+    if (co != NULL)
+    {
+        *head = co->next;
+        if (*head == NULL)
+        {
+            *tail = NULL;
+        }
+    }
+    return co;
+}
+
+static void free_stack(char *stack)
+{
+    *(char **)stack = free_stacks;
+    free_stacks = stack;
+}
+
+// Get a stack, reusing one if possible. Stacks are mapped in slabs because the
+// number of mappings per process is limited (vm.max_map_count)
+static char *alloc_stack()
+{
+    if (free_stacks == NULL)
+    {
+        // Each stack is preceded by a page that guards it, since stacks grow down
+        size_t page_size = sysconf(_SC_PAGESIZE);
+        size_t stride = page_size + (CO_STACK_SIZE + page_size - 1) / page_size * page_size;
+        char *slab = mmap(NULL, stride * CO_STACKS_PER_SLAB, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (slab == MAP_FAILED)
+        {
+            return NULL;
+        }
+        for (int i = CO_STACKS_PER_SLAB - 1; i >= 0; i--)
+        {
+            if (guarded_stacks < CO_GUARDED_STACKS)
+            {
+                if (mprotect(slab + stride * i, page_size, PROT_NONE) == 0)
+                {
+                    guarded_stacks++;
+                }
+                else
+                {
+                    perror("mprotect() error, coroutine stacks have no guard page from now on");
+                    guarded_stacks = CO_GUARDED_STACKS;
+                }
+            }
+            free_stack(slab + stride * i + page_size);
+        }
+    }
+    char *stack = free_stacks;
+    free_stacks = *(char **)stack;
+    return stack;
+}
+
+// Give the carrier back control until this coroutine is made ready again
+static void park()
+{
+    if (current == NULL)
+    {
+        fprintf(stderr, "%s: the main thread cannot block\n", __func__);
+        abort();
+    }
+    swapcontext(&current->context, &carrier_context);
+}
+
+static void trampoline()
+{
+    current->func(current->arg);
+    current->done = true;
+    swapcontext(&current->context, &carrier_context);
+}
+
+int co_create(struct coroutine **co, void *(*func)(void *), void *arg, bool detached)
+{
+    struct coroutine *new_co = calloc(1, sizeof(struct coroutine));
+    if (new_co == NULL)
+    {
+        return ENOMEM;
+    }
+    new_co->stack = alloc_stack();
+    if (new_co->stack == NULL)
+    {
+        free(new_co);
+        return ENOMEM;
+    }
+    new_co->func = func;
+    new_co->arg = arg;
+    new_co->detached = detached;
+
+    getcontext(&new_co->context);
+    new_co->context.uc_stack.ss_sp = new_co->stack;
+    new_co->context.uc_stack.ss_size = CO_STACK_SIZE;
+    new_co->context.uc_link = NULL;
+    makecontext(&new_co->context, trampoline, 0);
+
+    enqueue(&run_head, &run_tail, new_co);
+    if (co != NULL)
+    {
+        *co = new_co;
+    }
+    return 0;
+}
+
+// Run coroutines until co has ended, then free it
+int co_join(struct coroutine *co)
+{
+    if (current != NULL)
+    {
+        // Joining from a coroutine: wait for co by letting the others run
+        while (!co->done)
+        {
+            enqueue(&run_head, &run_tail, current);
+            park();
+        }
+    }
+    else
+    {
+        while (!co->done)
+        {
+            struct coroutine *next = dequeue(&run_head, &run_tail);
+            if (next == NULL)
+            {
+                fprintf(stderr, "%s: deadlock, every coroutine is blocked\n", __func__);
+                return EDEADLK;
+            }
+            current = next;
+            swapcontext(&carrier_context, &next->context);
+            current = NULL;
+
+            // The stack can only be released once we are off it
+            if (next->done)
+            {
+                free_stack(next->stack);
+                next->stack = NULL;
+                if (next->detached)
+                {
+                    free(next);
+                }
+            }
+        }
+    }
+    free(co);
+    return 0;
+}
+
+void co_mutex_init(struct co_mutex *mutex)
+{
+    mutex->locked = false;
+    mutex->head = NULL;
+    mutex->tail = NULL;
+}
+
+int co_mutex_lock(struct co_mutex *mutex)
+{
+    if (!mutex->locked)
+    {
+        mutex->locked = true;
+        return 0;
+    }
+    // The unlocking coroutine hands the mutex straight to us
+    enqueue(&mutex->head, &mutex->tail, current);
+    park();
+    return 0;
+}
+
+int co_mutex_trylock(struct co_mutex *mutex)
+{
+    if (mutex->locked)
+    {
+        return EBUSY;
+    }
+    mutex->locked = true;
+    return 0;
+}
+
+int co_mutex_unlock(struct co_mutex *mutex)
+{
+    struct coroutine *waiter = dequeue(&mutex->head, &mutex->tail);
+    if (waiter != NULL)
+    {
+        // Stays locked, now owned by the waiter
+        enqueue(&run_head, &run_tail, waiter);
+    }
+    else
+    {
+        mutex->locked = false;
+    }
+    return 0;
+}
+
+void co_cond_init(struct co_cond *cond)
+{
+    cond->head = NULL;
+    cond->tail = NULL;
+}
+
+int co_cond_wait(struct co_cond *cond, struct co_mutex *mutex)
+{
+    enqueue(&cond->head, &cond->tail, current);
+    co_mutex_unlock(mutex);
+    park();
+    return co_mutex_lock(mutex);
+}
+
+int co_cond_signal(struct co_cond *cond)
+{
+    struct coroutine *waiter = dequeue(&cond->head, &cond->tail);
+    if (waiter != NULL)
+    {
+        enqueue(&run_head, &run_tail, waiter);
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#include <stdbool.h>
+
+/*
+Cooperative user-space threads, used instead of pthreads when built with -DCOROUTINE.
+All coroutines run on the thread that calls co_join, and only switch when they block
+on a co_mutex or co_cond, so switches cost a swapcontext instead of a futex and a
+kernel reschedule. Stacks are small (CO_STACK_SIZE) and reused once a coroutine ends.
+The first CO_GUARDED_STACKS stacks sit above a PROT_NONE guard page, so an overflow faults
+instead of corrupting the next stack. Each guard page costs two of the process's mappings
+(vm.max_map_count, 65530 by default), so stacks past that have no guard.
+*/
+#ifndef CO_STACK_SIZE
+#define CO_STACK_SIZE (64 * 1024)
+#endif
+#define CO_STACKS_PER_SLAB 64
+#ifndef CO_GUARDED_STACKS
+#define CO_GUARDED_STACKS 16384
+#endif
+
+struct coroutine;
+
+struct co_mutex {
+    bool locked;
+    struct coroutine *head; // Coroutines waiting for the mutex, in order
+    struct coroutine *tail;
+};
+
+struct co_cond {
+    struct coroutine *head; // Coroutines waiting for a signal, in order
+    struct coroutine *tail;
+};
+
+int co_create(struct coroutine **co, void *(*func)(void *), void *arg, bool detached);
+int co_join(struct coroutine *co);
+
+void co_mutex_init(struct co_mutex *mutex);
+int co_mutex_lock(struct co_mutex *mutex);
+int co_mutex_trylock(struct co_mutex *mutex);
+int co_mutex_unlock(struct co_mutex *mutex);
+void co_cond_init(struct co_cond *cond);
+int co_cond_wait(struct co_cond *cond, struct co_mutex *mutex);
+int co_cond_signal(struct co_cond *cond);
+
+#endif
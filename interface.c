@@ -1,9 +1,14 @@
+#include <string.h>
+
 #include "interface.h"
 #include "scheduler.h"
 
 // Interface implementation
 // Implement APIs here...
 
+static void init_thread_conds(int from, int to);
+static void grow_slots();
+
 // Initialize the CPU scheduler
 void init_scheduler(enum sch_type type, int thread_count)
 {
@@ -15,14 +20,16 @@ void init_scheduler(enum sch_type type, int thread_count)
     io_end_time = 0;
 
     // Initialize all mutexes
-    pthread_mutex_init(&worker_mutex, NULL);
-    pthread_mutex_init(&process_mutex, NULL);
-    pthread_mutex_init(&semaphore_mutex, NULL);
+    mutex_init(&worker_mutex);
+    mutex_init(&process_mutex);
+    mutex_init(&semaphore_mutex);
 
     // Initialize all queues
     init_priority_queue(&cpu_queue);
     init_priority_queue(&io_queue);
     init_priority_queue(&threads_waiting);
+    init_wheel(&wakeup_wheel, 0);
+    io_head_end = -1;
 
     // Initialize semaphores array such that the initial value is 0
     semaphores = malloc(sizeof(struct semaphore) * MAX_NUM_SEM);
@@ -33,30 +40,48 @@ void init_scheduler(enum sch_type type, int thread_count)
     }
 
     // Initialize condition variables
-    pthread_cond_init(&semaphore_cond, NULL);
-    pthread_cond_init(&all_active_cond, NULL);
-    pthread_cond_init(&ready, NULL);
+    cond_init(&semaphore_cond);
+    cond_init(&all_active_cond);
+    cond_init(&ready);
 
     // Initially all variables each thread has
-    thread_wakeup_conds = malloc(sizeof(pthread_cond_t) * thread_count);
-    thread_run_conds = malloc(sizeof(pthread_cond_t) * thread_count);
+    thread_wakeup_conds = malloc(sizeof(cond_t *) * thread_count);
+    thread_run_conds = malloc(sizeof(cond_t *) * thread_count);
     cpu_arrival_times = malloc(sizeof(float) * thread_count);
     io_durations = malloc(sizeof(int) * thread_count);
     active = malloc(sizeof(bool) * thread_count);
+    active_count = 0;
     consecutive_run_time = malloc(sizeof(int) * thread_count);
     last_run_time = malloc(sizeof(int) * thread_count);
     current_level = malloc(sizeof(int) * thread_count);
+    cfs_weight = malloc(sizeof(int) * thread_count);
+    cfs_vruntime = malloc(sizeof(long) * thread_count);
+    cfs_slice = malloc(sizeof(int) * thread_count);
+    cfs_slice_run = malloc(sizeof(int) * thread_count);
+    job_release = malloc(sizeof(float) * thread_count);
+    job_deadline = malloc(sizeof(float) * thread_count);
+    deadline_stats = calloc(thread_count, sizeof(struct deadline_stats));
+    ended = malloc(sizeof(bool) * thread_count);
+    op_cursor = malloc(sizeof(int) * thread_count);
+    cpu_remaining = malloc(sizeof(int) * thread_count);
+    resume_state = malloc(sizeof(enum resume_state) * thread_count);
+    resume_time = malloc(sizeof(float) * thread_count);
+
+    task_id = malloc(sizeof(int) * thread_count);
+    last_dispatch = malloc(sizeof(int) * thread_count);
+    burst_estimate = malloc(sizeof(float) * thread_count);
+    burst_run = malloc(sizeof(int) * thread_count);
+    psjf_alpha = PSJF_DEFAULT_ALPHA;
+    psjf_initial_estimate = PSJF_DEFAULT_INITIAL_ESTIMATE;
+    predictions = 0;
+    prediction_abs_error = 0.0;
+    prediction_error = 0.0;
+    prediction_max_error = 0.0;
 
     for (int i = 0; i < thread_count; i++)
     {
-        cpu_arrival_times[i] = -1.0;
-        io_durations[i] = 0;
-        active[i] = false;
-        consecutive_run_time[i] = 0;
-        last_run_time[i] = -2;
-        current_level[i] = 0;
-        pthread_cond_init(&thread_wakeup_conds[i], NULL);
-        pthread_cond_init(&thread_run_conds[i], NULL);
+        reset_thread(i);
+        task_id[i] = i;
     }
 
     mlfq_queues = malloc(sizeof(struct priority_queue) * 5);
@@ -68,54 +93,351 @@ void init_scheduler(enum sch_type type, int thread_count)
         init_priority_queue(&mlfq_queues[i]);
         time_quantum[i] = 5*(1+i);
     }
+
+    // Initialize CFS
+    init_rb_tree(&cfs_tree);
+    cfs_current = -1;
+    cfs_min_vruntime = 0;
+    cfs_load = 0;
+    cfs_target_latency = CFS_DEFAULT_TARGET_LATENCY;
+    cfs_min_granularity = CFS_DEFAULT_MIN_GRANULARITY;
+
+    checkpoint_time = -1;
+    checkpoint_file = NULL;
+
+    online = false;
+    cond_init(&all_ended_cond);
+
+    switch_cost = 0;
+    cache_penalty = 0;
+    cache_decay = CACHE_DEFAULT_DECAY;
+    cpu_last_tid = -1;
+    switch_tid = -1;
+    switch_left = 0;
+    switches = 0;
+    switch_ticks = 0;
+    cache_ticks = 0;
+    cpu_run_ticks = 0;
+
+    // Name the locks and conds for the contention profile (PROFILE builds only)
+    prof_init();
+    prof_register(&worker_mutex, sizeof(mutex_t), 1, "worker_mutex", false);
+    prof_register(&process_mutex, sizeof(mutex_t), 1, "process_mutex", false);
+    prof_register(&semaphore_mutex, sizeof(mutex_t), 1, "semaphore_mutex", false);
+    prof_register(&cpu_queue.mutex, sizeof(mutex_t), 1, "cpu_queue", false);
+    prof_register(&io_queue.mutex, sizeof(mutex_t), 1, "io_queue", false);
+    prof_register(&threads_waiting.mutex, sizeof(mutex_t), 1, "threads_waiting", false);
+    prof_register(&mlfq_queues[0].mutex, sizeof(struct priority_queue), 5, "mlfq_queues", false);
+    prof_register(&semaphores[0].queue.mutex, sizeof(struct semaphore), MAX_NUM_SEM, "semaphore queues", false);
+    prof_register(&ready, sizeof(cond_t), 1, "ready", true);
+    prof_register(&semaphore_cond, sizeof(cond_t), 1, "semaphore_cond", true);
+    init_thread_conds(0, thread_count);
+}
+
+// Give slots from to to - 1 their conds. They are allocated apart from the slot arrays and never
+// move, since threads keep waiting on them while online mode grows the arrays
+static void init_thread_conds(int from, int to)
+{
+    cond_t *wakeup_conds = malloc(sizeof(cond_t) * (to - from));
+    cond_t *run_conds = malloc(sizeof(cond_t) * (to - from));
+    for (int i = from; i < to; i++)
+    {
+        thread_wakeup_conds[i] = &wakeup_conds[i - from];
+        thread_run_conds[i] = &run_conds[i - from];
+        cond_init(thread_wakeup_conds[i]);
+        cond_init(thread_run_conds[i]);
+    }
+    prof_register(run_conds, sizeof(cond_t), to - from, "thread_run_conds", true);
+    prof_register(wakeup_conds, sizeof(cond_t), to - from, "thread_wakeup_conds", true);
+}
+
+// Put a thread's slot back in the state of a thread that has not arrived yet
+void reset_thread(int tid)
+{
+    cpu_arrival_times[tid] = -1.0;
+    io_durations[tid] = 0;
+    active[tid] = false;
+    consecutive_run_time[tid] = 0;
+    last_run_time[tid] = -2;
+    current_level[tid] = 0;
+    cfs_weight[tid] = CFS_NICE_0_LOAD;
+    cfs_vruntime[tid] = -1; // Not yet placed on the timeline
+    cfs_slice[tid] = 0;
+    cfs_slice_run[tid] = 0;
+    job_release[tid] = -1.0;
+    job_deadline[tid] = -1.0;
+    memset(&deadline_stats[tid], 0, sizeof(struct deadline_stats));
+    ended[tid] = false;
+    op_cursor[tid] = 0;
+    cpu_remaining[tid] = 0;
+    resume_state[tid] = RESUME_NONE;
+    resume_time[tid] = -1.0;
+    last_dispatch[tid] = -1;
+    burst_estimate[tid] = psjf_initial_estimate;
+    burst_run[tid] = 0;
+    if (cpu_last_tid == tid)
+    {
+        // A new task in this slot starts with a cold cache
+        cpu_last_tid = -1;
+    }
+}
+
+// Switch to online mode, where tasks are admitted as they arrive instead of all at start.
+// The last slot is kept for the reader that admits them; returns its tid
+int init_online()
+{
+    online = true;
+    reader_tid = num_threads - 1;
+    threads_remaining = 1;
+
+    // Hand out low slots first
+    free_slots = malloc(sizeof(int) * num_threads);
+    num_free_slots = 0;
+    for (int i = reader_tid - 1; i >= 0; i--)
+    {
+        free_slots[num_free_slots++] = i;
+    }
+    return reader_tid;
+}
+
+// Double the number of slots once every one is in use, so they only grow with the most tasks
+// in the system at once. The reader keeps its slot, and the new ones go on the free stack.
+// Called with worker_mutex held; semaphore_mutex is taken too, as P uses its thread's slot with only that
+static void grow_slots()
+{
+    int old_count = num_threads;
+    int count = old_count * 2;
+
+    mutex_lock(&semaphore_mutex);
+    thread_wakeup_conds = realloc(thread_wakeup_conds, sizeof(cond_t *) * count);
+    thread_run_conds = realloc(thread_run_conds, sizeof(cond_t *) * count);
+    cpu_arrival_times = realloc(cpu_arrival_times, sizeof(float) * count);
+    io_durations = realloc(io_durations, sizeof(int) * count);
+    active = realloc(active, sizeof(bool) * count);
+    consecutive_run_time = realloc(consecutive_run_time, sizeof(int) * count);
+    last_run_time = realloc(last_run_time, sizeof(int) * count);
+    current_level = realloc(current_level, sizeof(int) * count);
+    cfs_weight = realloc(cfs_weight, sizeof(int) * count);
+    cfs_vruntime = realloc(cfs_vruntime, sizeof(long) * count);
+    cfs_slice = realloc(cfs_slice, sizeof(int) * count);
+    cfs_slice_run = realloc(cfs_slice_run, sizeof(int) * count);
+    job_release = realloc(job_release, sizeof(float) * count);
+    job_deadline = realloc(job_deadline, sizeof(float) * count);
+    deadline_stats = realloc(deadline_stats, sizeof(struct deadline_stats) * count);
+    ended = realloc(ended, sizeof(bool) * count);
+    op_cursor = realloc(op_cursor, sizeof(int) * count);
+    cpu_remaining = realloc(cpu_remaining, sizeof(int) * count);
+    resume_state = realloc(resume_state, sizeof(enum resume_state) * count);
+    resume_time = realloc(resume_time, sizeof(float) * count);
+    task_id = realloc(task_id, sizeof(int) * count);
+    last_dispatch = realloc(last_dispatch, sizeof(int) * count);
+    burst_estimate = realloc(burst_estimate, sizeof(float) * count);
+    burst_run = realloc(burst_run, sizeof(int) * count);
+    free_slots = realloc(free_slots, sizeof(int) * count);
+
+    num_threads = count;
+    for (int i = old_count; i < count; i++)
+    {
+        reset_thread(i);
+        task_id[i] = i;
+    }
+    init_thread_conds(old_count, count);
+    for (int i = count - 1; i >= old_count; i--)
+    {
+        free_slots[num_free_slots++] = i;
+    }
+    mutex_unlock(&semaphore_mutex);
+}
+
+// The reader calls this function with the arrival time of the next task in its input.
+// Once the clock reaches it, the task gets a free slot, which is returned
+int admit_me(float current_time, int tid, int id)
+{
+    mutex_lock(&process_mutex);
+    mutex_lock(&worker_mutex);
+    mutex_unlock(&process_mutex);
+
+    wait_until_turn(tid, current_time);
+
+    if (num_free_slots == 0)
+    {
+        grow_slots();
+    }
+    int slot = free_slots[--num_free_slots];
+    reset_thread(slot);
+    task_id[slot] = id;
+    threads_remaining++;
+    trace_thread(slot);
+
+    // The reader is inactive while it reads the next task, so time stops until it arrives
+    set_active(tid, false);
+    cond_signal(&ready);
+    mutex_unlock(&worker_mutex);
+    return slot;
+}
+
+// The reader calls this function after end_me at the end of its input, to wait for the last task
+void wait_all_ended()
+{
+    mutex_lock(&process_mutex);
+    mutex_lock(&worker_mutex);
+    mutex_unlock(&process_mutex);
+
+    while (threads_remaining > 0)
+    {
+        cond_wait(&all_ended_cond, &worker_mutex);
+    }
+    mutex_unlock(&worker_mutex);
+}
+
+// Override the CFS scheduling period and minimum slice (in ticks)
+void set_cfs_params(int target_latency, int min_granularity)
+{
+    if (target_latency > 0)
+    {
+        cfs_target_latency = target_latency;
+    }
+    if (min_granularity > 0)
+    {
+        cfs_min_granularity = min_granularity;
+    }
+}
+
+// Set the ticks lost to each context switch, and the most ticks lost to refilling a cold cache
+// with the time constant of the cache going cold
+void set_switch_cost(int switch_ticks, int cache_ticks, float decay)
+{
+    switch_cost = switch_ticks > 0 ? switch_ticks : 0;
+    cache_penalty = cache_ticks > 0 ? cache_ticks : 0;
+    if (decay > 0)
+    {
+        cache_decay = decay;
+    }
+}
+
+// Set the weight of the last burst in the PSJF estimate, and the estimate of a first burst
+// (a negative alpha or an initial estimate that isn't positive keeps the default)
+void set_psjf_params(float alpha, float initial_estimate)
+{
+    if (alpha >= 0 && alpha <= 1)
+    {
+        psjf_alpha = alpha;
+    }
+    if (initial_estimate > 0)
+    {
+        psjf_initial_estimate = initial_estimate;
+        for (int i = 0; i < num_threads; i++)
+        {
+            burst_estimate[i] = initial_estimate;
+        }
+    }
+}
+
+// Save the simulation state to file_name when the global clock reaches time
+void set_checkpoint(int time, char *file_name)
+{
+    checkpoint_time = time;
+    checkpoint_file = file_name;
+}
+
+// Restore a checkpoint saved with the same scheduler type and input
+int resume_checkpoint(char *file_name)
+{
+    return load_checkpoint(file_name);
+}
+
+// A thread calls this function before each operation with the operation's index in its input line
+void cursor_me(int tid, int op_index)
+{
+    op_cursor[tid] = op_index;
+}
+
+// After resume_checkpoint, get the operation a thread has to resume at and its remaining_time
+// and current_time, or -1 if the thread had already ended
+int resume_cursor(int tid, int *remaining_time, float *current_time)
+{
+    if (resume_state[tid] == RESUME_ENDED)
+    {
+        return -1;
+    }
+    *remaining_time = cpu_remaining[tid];
+    if (resume_state[tid] == RESUME_WAITING)
+    {
+        // It will call the operation again, as if it had not been called yet
+        *current_time = resume_time[tid];
+        resume_state[tid] = RESUME_NONE;
+    }
+    return op_cursor[tid];
 }
 
 // A thread calls this function for CPU burst, with the remaining_time in this burst
 int cpu_me(float current_time, int tid, int remaining_time)
 {
     // Wait until it can be processed
-    pthread_mutex_lock(&process_mutex);
-    pthread_mutex_lock(&worker_mutex);
-    pthread_mutex_unlock(&process_mutex);
+    mutex_lock(&process_mutex);
+    mutex_lock(&worker_mutex);
+    mutex_unlock(&process_mutex);
 
     if (remaining_time == 0)
     {
+        // Burst is over, check it against its deadline
+        if (job_deadline[tid] >= 0)
+        {
+            record_deadline(tid, current_time);
+        }
+        record_burst(tid);
+
         cpu_arrival_times[tid] = -1.0; // Reset arrival time
-        active[tid] = false;
+        set_active(tid, false);
 
         // Reset MLFQ info
         last_run_time[tid] = -2;
         consecutive_run_time[tid] = 0;
+        if (current_level[tid] != 0)
+        {
+            trace_level(tid, 0, current_time);
+        }
         current_level[tid] = 0;
 
         // Return control
-        pthread_mutex_unlock(&worker_mutex);
+        mutex_unlock(&worker_mutex);
         return current_time;
     }
 
-    // Wait until the thread has arrived according to global clock
-    wait_until_turn(tid, current_time);
-
-    // Update the arrival time for the thread if needed
-    if (cpu_arrival_times[tid] == -1.0)
+    cpu_remaining[tid] = remaining_time;
+    if (resume_state[tid] == RESUME_QUEUED)
     {
-        cpu_arrival_times[tid] = current_time;
+        // Already in the restored CPU queue, just wait to be called
+        resume_state[tid] = RESUME_NONE;
+        park_until_run(tid);
+    }
+    else
+    {
+        // Wait until the thread has arrived according to global clock
+        wait_until_turn(tid, current_time);
+
+        // Update the arrival time for the thread if needed
+        if (cpu_arrival_times[tid] == -1.0)
+        {
+            cpu_arrival_times[tid] = current_time;
+            deadline_stats[tid].burst = remaining_time;
+        }
+
+        // Schedule thread
+        schedule(&cpu_queue, schedule_type, tid, cpu_arrival_times[tid], remaining_time);
+
+        // Completed scheduling
+        cond_signal(&ready);
+        // Give back the mutex (so the ready thread can run) and wait for this thread to be called
+        cond_wait(thread_run_conds[tid], &worker_mutex);
     }
-
-    // Schedule thread
-    schedule(&cpu_queue, schedule_type, tid, cpu_arrival_times[tid], remaining_time);
-
-    // Completed scheduling
-    pthread_cond_signal(&ready);
-    // Give back the mutex (so the ready thread can run) and wait for this thread to be called
-    pthread_cond_wait(&thread_run_conds[tid], &worker_mutex);
 
     // Finish thread
-    active[tid] = false;
+    set_active(tid, false);
     int time = global_time;
 
-    pthread_cond_signal(&ready); // Done running
-    pthread_mutex_unlock(&worker_mutex);
+    cond_signal(&ready); // Done running
+    mutex_unlock(&worker_mutex);
 
     return time;
 }
@@ -123,32 +445,46 @@ int cpu_me(float current_time, int tid, int remaining_time)
 int io_me(float current_time, int tid, int duration)
 {
     // Wait until it can be processed
-    pthread_mutex_lock(&process_mutex);
+    mutex_lock(&process_mutex);
 
-    pthread_mutex_lock(&worker_mutex);
-    pthread_mutex_unlock(&process_mutex);
+    mutex_lock(&worker_mutex);
+    mutex_unlock(&process_mutex);
 
     io_durations[tid] = duration;
 
     // Finished processing
 
-    // Wait until the thread has arrived according to global clock
-    wait_until_turn(tid, current_time);
-
-    // Schedule thread
-    schedule(&io_queue, 0, tid, current_time, -1);
-
-    // Completed scheduling
-    pthread_cond_signal(&ready);
-    // Give back the mutex (so the ready thread can run) and wait for this thread to be called
-    pthread_cond_wait(&thread_run_conds[tid], &worker_mutex);
+    if (resume_state[tid] == RESUME_QUEUED)
+    {
+        // Already in the restored I/O queue, just wait to be called
+        resume_state[tid] = RESUME_NONE;
+        park_until_run(tid);
+    }
+    else
+    {
+        // Wait until the thread has arrived according to global clock
+        wait_until_turn(tid, current_time);
+
+        // Schedule thread
+        schedule(&io_queue, 0, tid, current_time, -1);
+        if (peek(&io_queue) == tid)
+        {
+            // New head, so its completion time has to be worked out again
+            io_head_end = -1;
+        }
+
+        // Completed scheduling
+        cond_signal(&ready);
+        // Give back the mutex (so the ready thread can run) and wait for this thread to be called
+        cond_wait(thread_run_conds[tid], &worker_mutex);
+    }
 
     // Finish thread
-    active[tid] = false;
+    set_active(tid, false);
     int time = global_time;
 
-    pthread_cond_signal(&ready);
-    pthread_mutex_unlock(&worker_mutex);
+    cond_signal(&ready);
+    mutex_unlock(&worker_mutex);
 
     return time;
 }
@@ -156,77 +492,263 @@ int io_me(float current_time, int tid, int duration)
 int P(float current_time, int tid, int sem_id)
 {
     // Wait until it can be processed
-    pthread_mutex_lock(&process_mutex);
-    pthread_mutex_lock(&worker_mutex);
-    pthread_mutex_unlock(&process_mutex);
+    mutex_lock(&process_mutex);
+    mutex_lock(&worker_mutex);
+    mutex_unlock(&process_mutex);
 
-    // Wait until the thread has arrived according to global clock
-    wait_until_turn(tid, current_time);
+    bool will_wait;
+    if (resume_state[tid] == RESUME_SEMAPHORE)
+    {
+        // Already in the restored semaphore queue, just wait for V
+        resume_state[tid] = RESUME_NONE;
+        mutex_lock(&semaphore_mutex);
+        set_active(tid, true);
+        if (all_active())
+        {
+            start_clock();
+        }
+        will_wait = true;
+    }
+    else
+    {
+        // Wait until the thread has arrived according to global clock
+        wait_until_turn(tid, current_time);
 
-    pthread_mutex_lock(&semaphore_mutex);
-    // Maybe these should not happen here
-    push(&semaphores[sem_id].queue, tid, tid, -1);
-    semaphores[sem_id].S--;
+        mutex_lock(&semaphore_mutex);
+        // Maybe these should not happen here
+        push(&semaphores[sem_id].queue, tid, tid, -1);
+        semaphores[sem_id].S--;
 
-    bool will_wait = semaphores[sem_id].S < 0;
+        will_wait = semaphores[sem_id].S < 0;
 
-    if (!will_wait)
-    {
-        active[tid] = false;
+        if (!will_wait)
+        {
+            set_active(tid, false);
+        }
+        cond_signal(&ready);
     }
-    pthread_cond_signal(&ready);
-    pthread_mutex_unlock(&worker_mutex);
+    mutex_unlock(&worker_mutex);
 
     if (will_wait)
     {
-        pthread_cond_wait(&thread_run_conds[tid], &semaphore_mutex);
+        cond_wait(thread_run_conds[tid], &semaphore_mutex);
+        trace_semaphore(tid, sem_id, current_time, global_time);
     }
     pop(&semaphores[sem_id].queue);
-    active[tid] = false;
+    set_active(tid, false);
     int time = global_time;
-    pthread_mutex_unlock(&semaphore_mutex);
-    pthread_cond_signal(&semaphore_cond);
+    mutex_unlock(&semaphore_mutex);
+    cond_signal(&semaphore_cond);
 
     return time;
 }
 
 int V(float current_time, int tid, int sem_id)
 {
-    pthread_mutex_lock(&process_mutex);
-    pthread_mutex_lock(&worker_mutex);
-    pthread_mutex_unlock(&process_mutex);
+    mutex_lock(&process_mutex);
+    mutex_lock(&worker_mutex);
+    mutex_unlock(&process_mutex);
 
     wait_until_turn(tid, current_time);
-    active[tid] = false;
+    set_active(tid, false);
 
     // Signal/Pause need to be able to pass between
-    pthread_mutex_lock(&semaphore_mutex);
+    mutex_lock(&semaphore_mutex);
     // Maybe this should not happen here
-    pthread_mutex_unlock(&worker_mutex);
+    mutex_unlock(&worker_mutex);
 
     semaphores[sem_id].S++;
     if (semaphores[sem_id].S <= 0)
     {
-        pthread_cond_signal(&thread_run_conds[semaphores[sem_id].queue.head->tid]);
-        pthread_cond_wait(&semaphore_cond, &semaphore_mutex);
+        cond_signal(thread_run_conds[semaphores[sem_id].queue.head->tid]);
+        cond_wait(&semaphore_cond, &semaphore_mutex);
     }
-    pthread_cond_signal(&ready);
-    pthread_mutex_unlock(&semaphore_mutex);
+    cond_signal(&ready);
+    mutex_unlock(&semaphore_mutex);
     return ceil(current_time);
 }
 
 void end_me(int tid)
 {
-    pthread_mutex_lock(&process_mutex);
-    pthread_mutex_lock(&worker_mutex);
-    pthread_mutex_unlock(&process_mutex);
+    mutex_lock(&process_mutex);
+    mutex_lock(&worker_mutex);
+    mutex_unlock(&process_mutex);
 
+    ended[tid] = true;
     threads_remaining--;
+    if (online && tid != reader_tid)
+    {
+        // Report the task before its slot is given to another one
+        report_deadline(tid);
+        free_slots[num_free_slots++] = tid;
+    }
+    if (online && threads_remaining == 0)
+    {
+        cond_signal(&all_ended_cond);
+    }
     if (all_active())
     {
-        pthread_t global_clock_thread;
-        pthread_create(&global_clock_thread, NULL, &threadFunc, NULL);
+        start_clock();
+    }
+    cond_signal(&ready);
+    mutex_unlock(&worker_mutex);
+}
+
+
+// Weight of each nice level from -20 to 19, as in the Linux CFS (nice 0 = 1024)
+static const int nice_to_weight[40] = {
+    88761, 71755, 56483, 46273, 36291,
+    29154, 23254, 18705, 14949, 11916,
+    9548, 7620, 6100, 4904, 3906,
+    3121, 2501, 1991, 1586, 1277,
+    1024, 820, 655, 526, 423,
+    335, 272, 215, 172, 137,
+    110, 87, 70, 56, 45,
+    36, 29, 23, 18, 15,
+};
+
+// A thread calls this function to change its nice value, which sets its CFS weight
+void nice_me(int tid, int nice)
+{
+    // Clamp to the valid nice range
+    nice = fmax(-20, fmin(19, nice));
+
+    mutex_lock(&process_mutex);
+    mutex_lock(&worker_mutex);
+    mutex_unlock(&process_mutex);
+
+    cfs_weight[tid] = nice_to_weight[nice + 20];
+    mutex_unlock(&worker_mutex);
+}
+
+// A thread calls this function before a CPU burst that must finish by deadline
+void deadline_me(int tid, float release, float deadline, float period)
+{
+    mutex_lock(&process_mutex);
+    mutex_lock(&worker_mutex);
+    mutex_unlock(&process_mutex);
+
+    job_release[tid] = release;
+    job_deadline[tid] = deadline;
+    deadline_stats[tid].period = period;
+    mutex_unlock(&worker_mutex);
+}
+
+static int deadline_rows;           // Rows of the deadline report printed so far
+static int periodic_rows;
+static float total_utilization;     // Of the periodic threads
+static float total_density;         // Of the periodic threads
+static long total_jobs;
+static long total_misses;
+
+// Print tid's row of the deadline report if it declared a deadline, after the header if it is the first
+void report_deadline(int tid)
+{
+    struct deadline_stats *stats = &deadline_stats[tid];
+    if (stats->jobs == 0)
+    {
+        return;
+    }
+    if (deadline_rows++ == 0)
+    {
+        printf("Deadlines:\n");
+        printf("%4s %5s %6s %9s %9s %7s %7s %-6s %s\n", "tid", "jobs", "misses", "mean late", "max late",
+               "util", "density", "status", "lateness histogram (met, <=1, <=2, <=4, <=8, <=16, >16)");
+    }
+    total_jobs += stats->jobs;
+    total_misses += stats->misses;
+
+    printf("%4d %5d %6d %9.2f %9.2f ", task_id[tid], stats->jobs, stats->misses,
+           stats->lateness_sum / stats->jobs, stats->lateness_max);
+    if (stats->period > 0)
+    {
+        // Longest burst over the period
+        float utilization = stats->wcet / stats->period;
+        periodic_rows++;
+        total_utilization += utilization;
+        total_density += stats->density;
+        printf("%7.3f", utilization);
+    }
+    else
+    {
+        // Aperiodic threads have no utilization, only the density of their jobs
+        printf("%7s", "-");
+    }
+    printf(" %7.3f %-6s", stats->density, stats->misses == 0 ? "met" : "missed");
+    for (int b = 0; b < DEADLINE_BUCKETS; b++)
+    {
+        printf(" %d", stats->lateness_hist[b]);
+    }
+    printf("\n");
+}
+
+// Print the time lost to context switches, if they cost anything
+static void report_switches()
+{
+    if (switch_cost == 0 && cache_penalty == 0)
+    {
+        return;
+    }
+    long lost = switch_ticks + cache_ticks;
+    long busy = cpu_run_ticks + lost;
+    printf("Context switches: %ld, switching: %ld ticks, cache refill: %ld ticks, lost: %.1f%% of busy CPU time\n",
+           switches, switch_ticks, cache_ticks, busy > 0 ? 100.0 * lost / busy : 0.0);
+}
+
+// Print how far the PSJF burst estimates were from the actual bursts
+static void report_predictions()
+{
+    if (schedule_type != SCH_PSJF || predictions == 0)
+    {
+        return;
+    }
+    printf("Burst predictions (alpha %.2f, initial %.1f): %ld, mean absolute error: %.2f ticks, "
+           "mean error: %.2f ticks, max absolute error: %.1f ticks\n",
+           psjf_alpha, psjf_initial_estimate, predictions, prediction_abs_error / predictions,
+           prediction_error / predictions, prediction_max_error);
+}
+
+// Print the deadline report for every thread that declared a deadline
+// (in online mode, tasks were already reported as they ended)
+void print_report()
+{
+    report_switches();
+    report_predictions();
+
+    if (!online)
+    {
+        for (int i = 0; i < num_threads; i++)
+        {
+            report_deadline(i);
+        }
+    }
+    if (deadline_rows == 0)
+    {
+        return;
+    }
+    if (online)
+    {
+        // Tasks that came and went don't add up to a utilization
+        printf("Tasks with deadlines: %d, jobs: %ld, misses: %ld\n", deadline_rows, total_jobs, total_misses);
+        return;
+    }
+
+    if (periodic_rows == 0)
+    {
+        // Densities of aperiodic jobs only add up where their windows overlap, so there is no verdict
+        printf("Tasks with deadlines: %d, jobs: %ld, misses: %ld (no periodic tasks to test)\n",
+               deadline_rows, total_jobs, total_misses);
+        return;
+    }
+
+    // EDF cannot meet every periodic deadline if utilization is above 1, and does if total density is
+    // at most 1 (the two are equal when deadlines equal periods, which makes the test exact)
+    const char *verdict = total_utilization > 1.0 ? "no" : total_density <= 1.0 ? "yes" : "not guaranteed";
+    printf("Periodic tasks: %d, total utilization: %.3f, total density: %.3f, EDF schedulable: %s",
+           periodic_rows, total_utilization, total_density, verdict);
+    if (periodic_rows < deadline_rows)
+    {
+        printf(" (%d aperiodic tasks not included)", deadline_rows - periodic_rows);
     }
-    pthread_cond_signal(&ready);
-    pthread_mutex_unlock(&worker_mutex);
+    printf("\n");
 }
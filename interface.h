@@ -6,6 +6,9 @@ enum sch_type {
     SCH_FCFS = 0,   // first come first served
     SCH_SRTF = 1,   // shortest remaining time first
     SCH_MLFQ = 2,   // multi-level feedback queue
+    SCH_CFS = 3,    // completely fair scheduler
+    SCH_EDF = 4,    // earliest deadline first
+    SCH_PSJF = 5,   // predictive shortest job first
 };
 struct action_struct;
 
@@ -16,6 +19,31 @@ int io_me(float current_time, int tid, int duration);
 int P(float current_time, int tid, int sem_id);
 int V(float current_time, int tid, int sem_id);
 void end_me(int tid);
+void nice_me(int tid, int nice);
+void deadline_me(int tid, float release, float deadline, float period);
+void print_report();
+
+// Chrome trace-event JSON export
+int open_trace(char *file_name);
+void close_trace();
+
+// Time series of queue lengths
+int open_samples(char *file_name, int interval);
+void close_samples();
+
+// Online mode
+int init_online();
+int admit_me(float current_time, int tid, int id);
+void wait_all_ended();
+
+// Checkpoint and resume
+void set_checkpoint(int time, char *file_name);
+int resume_checkpoint(char *file_name);
+void cursor_me(int tid, int op_index);
+int resume_cursor(int tid, int *remaining_time, float *current_time);
+void set_cfs_params(int target_latency, int min_granularity);
+void set_switch_cost(int switch_ticks, int cache_ticks, float decay);
+void set_psjf_params(float alpha, float initial_estimate);
 void global_clock();
 void * threadFunc(void * arg);
 
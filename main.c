@@ -6,40 +6,166 @@
 #include <stdbool.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
 #include <pthread.h>
 
 #include "interface.h"
+#include "sync.h"
 
 #define MAX_LINE_LEN 1024
+#define DEFAULT_ONLINE_SLOTS 1024
 FILE *gantt_file;
+bool resuming;  // threads start where the checkpoint left them
+bool streaming; // tasks are read and admitted as they arrive
+
+// scheduler tuning options (0 keeps the default)
+static int target_latency;
+static int min_granularity;
+static int context_switch_ticks;
+static int cache_refill_ticks;
+static float cache_cold_time;
+static float psjf_alpha = -1;            // 0 is a valid weight, so -1 keeps the default
+static float psjf_initial_estimate = -1;
+
+// load samples (interval 0 means none)
+static int sample_interval;
+static char *sample_file;
 
 struct thread_struct
 {
-    pthread_t p_t;           // pthread identifier
-    int tid;                 // tid
+    thread_t p_t;            // thread identifier
+    int tid;                 // slot the thread runs in
+    int id;                  // tid in the input file (the slot too, unless streaming)
     char line[MAX_LINE_LEN]; // tid's operations
 };
 
+struct reader_struct
+{
+    thread_t p_t;            // thread identifier
+    int tid;                 // slot the reader runs in
+    FILE *fp;                // input file, read as the clock reaches each arrival
+};
+
 void *thread_start(void *);
+void *read_tasks(void *);
 int get_line_count(char *file_name);
+int open_gantt(char *file_name, char *type_arg, char *input_name);
+int run_online(int scheduler_type, char *type_arg, char *input_file, char *input_name, int slots,
+               char *trace_file);
+void setup_scheduler(int scheduler_type, int num_threads);
+int start_sampling(char *type_arg, char *input_name);
+void print_usage();
 
 // Main function
 // Read input file and create threads accordingly
 int main(int argc, char **argv)
 {
     printf("%s: Hello Project 1!\n", __func__);
-    if (argc != 3)
+
+    // Get options
+    int checkpoint_time = -1;
+    char *checkpoint_file = NULL;
+    char *resume_file = NULL;
+    char *trace_file = NULL;
+    int online_slots = 0;
+    char *end;
+    int opt;
+    while ((opt = getopt(argc, argv, "l:g:s:S:r:t:n:x:w:d:p:P:a:e:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            online_slots = atoi(optarg);
+            if (online_slots <= 0)
+            {
+                print_usage();
+                return -EINVAL;
+            }
+            break;
+        case 't':
+            trace_file = optarg;
+            break;
+        case 'p':
+            sample_interval = atoi(optarg);
+            break;
+        case 'P':
+            sample_file = optarg;
+            break;
+        case 's':
+            checkpoint_time = atoi(optarg);
+            break;
+        case 'S':
+            checkpoint_file = optarg;
+            break;
+        case 'r':
+            resume_file = optarg;
+            break;
+        case 'x':
+            context_switch_ticks = atoi(optarg);
+            break;
+        case 'w':
+            cache_refill_ticks = atoi(optarg);
+            break;
+        case 'd':
+            cache_cold_time = atof(optarg);
+            break;
+        case 'a':
+            psjf_alpha = strtof(optarg, &end);
+            if (*end != '\0' || !(psjf_alpha >= 0 && psjf_alpha <= 1))
+            {
+                print_usage();
+                return -EINVAL;
+            }
+            break;
+        case 'e':
+            psjf_initial_estimate = strtof(optarg, &end);
+            if (*end != '\0' || !(psjf_initial_estimate > 0))
+            {
+                print_usage();
+                return -EINVAL;
+            }
+            break;
+        case 'l':
+            target_latency = atoi(optarg);
+            break;
+        case 'g':
+            min_granularity = atoi(optarg);
+            break;
+        default:
+            print_usage();
+            return -EINVAL;
+        }
+    }
+    if (argc - optind != 2)
     {
-        fprintf(stderr, "Not enough parameters specified. Usage: ./proj1 <scheduler_type> <input_file>\n");
-        fprintf(stderr, "  Scheduler type: 0 - First Come, First Served\n");
-        fprintf(stderr, "  Scheduler type: 1 - Shortest Remaining Time First\n");
-        fprintf(stderr, "  Scheduler type: 2 - Multi-Level Feedback Queue\n");
+        fprintf(stderr, "Not enough parameters specified. ");
+        print_usage();
+        return -EINVAL;
+    }
+    char *type_arg = argv[optind];
+    char *input_file = argv[optind + 1];
+
+    // Input "-" is stdin, which is always read online
+    char *input_name = basename(input_file);
+    if (strcmp(input_file, "-") == 0)
+    {
+        input_name = "stdin";
+        if (online_slots == 0)
+            online_slots = DEFAULT_ONLINE_SLOTS;
+    }
+    streaming = online_slots > 0;
+    if (streaming && (checkpoint_time >= 0 || resume_file != NULL))
+    {
+        fprintf(stderr, "%s: checkpoints need the whole input, they can't be used online.\n", __func__);
         return -EINVAL;
     }
 
     // Get parameters
-    int scheduler_type = atoi(argv[1]);
-    int num_lines = get_line_count(argv[2]);
+    int scheduler_type = atoi(type_arg);
+    if (streaming)
+        return run_online(scheduler_type, type_arg, input_file, input_name, online_slots, trace_file);
+
+    int num_lines = get_line_count(input_file);
     if (num_lines <= 0)
     {
         fprintf(stderr, "%s: invalid input file.\n", __func__);
@@ -60,7 +186,7 @@ int main(int argc, char **argv)
     memset(threads, 0, sizeof(*threads) * num_threads);
 
     // Read each line and save inside threads[].line
-    FILE *fp = fopen(argv[2], "r");
+    FILE *fp = fopen(input_file, "r");
     char *buf = (char *)malloc(sizeof(char) * MAX_LINE_LEN);
     for (int i = 0; i < num_threads; ++i)
     {
@@ -79,30 +205,55 @@ int main(int argc, char **argv)
 
     // Open file for Gantt chart
     char temp[512] = {0};
-    mkdir("output", 0755);
-    strcat(temp, "output/gantt-");
-    strcat(temp, argv[1]);
-    strcat(temp, "-");
-    strcat(temp, basename(argv[2]));
-    gantt_file = fopen(temp, "w");
-    if (gantt_file == NULL)
-    {
-        perror("fopen() error");
+    if (open_gantt(temp, type_arg, input_name) != 0)
         return errno;
+
+    // Default checkpoint file sits next to the Gantt chart
+    char checkpoint_temp[512] = {0};
+    if (checkpoint_file == NULL)
+    {
+        strcat(checkpoint_temp, "output/checkpoint-");
+        strcat(checkpoint_temp, type_arg);
+        strcat(checkpoint_temp, "-");
+        strcat(checkpoint_temp, input_name);
+        checkpoint_file = checkpoint_temp;
     }
 
     // Init scheduler
-    init_scheduler(scheduler_type, num_threads);
+    setup_scheduler(scheduler_type, num_threads);
+    if (checkpoint_time >= 0)
+    {
+        set_checkpoint(checkpoint_time, checkpoint_file);
+    }
+    if (trace_file != NULL && open_trace(trace_file) != 0)
+    {
+        return -EINVAL;
+    }
+    if (start_sampling(type_arg, input_name) != 0)
+    {
+        return -EINVAL;
+    }
+    if (resume_file != NULL)
+    {
+        // Gantt chart only has what happens after the checkpoint
+        if (resume_checkpoint(resume_file) != 0)
+        {
+            return -EINVAL;
+        }
+        resuming = true;
+        printf("%s: Resumed from %s\n", __func__, resume_file);
+    }
 
     // Assign tid and create threads using threads[]
     int ret = 0;
     for (int i = 0; i < num_threads; ++i)
     {
         threads[i].tid = i;
-        ret = pthread_create(&(threads[i].p_t), NULL, thread_start, &(threads[i]));
+        threads[i].id = i;
+        ret = thread_create(&(threads[i].p_t), thread_start, &(threads[i]));
         if (ret)
         {
-            fprintf(stderr, "%s: pthread_create() error!\n", __func__);
+            fprintf(stderr, "%s: thread_create() error!\n", __func__);
             return -EPERM;
         }
     }
@@ -110,28 +261,182 @@ int main(int argc, char **argv)
     // Join threads
     for (int i = 0; i < num_threads; ++i)
     {
-        ret = pthread_join(threads[i].p_t, NULL);
+        ret = thread_join(threads[i].p_t);
         if (ret)
         {
-            fprintf(stderr, "%s: pthread_join() error!\n", __func__);
+            fprintf(stderr, "%s: thread_join() error!\n", __func__);
             return -EPERM;
         }
     }
 
     fclose(gantt_file);
     free(threads);
+    close_trace();
+    close_samples();
+
+    print_report();
+
+    printf("%s: Output file: %s\n", __func__, temp);
+    printf("%s: Bye!\n", __func__);
+    return 0;
+}
+
+// Init the scheduler for num_threads threads, with the tuning options
+void setup_scheduler(int scheduler_type, int num_threads)
+{
+    init_scheduler(scheduler_type, num_threads);
+    set_cfs_params(target_latency, min_granularity);
+    set_switch_cost(context_switch_ticks, cache_refill_ticks, cache_cold_time);
+    set_psjf_params(psjf_alpha, psjf_initial_estimate);
+}
+
+// Start writing load samples, by default to output/samples-<type>-<input>.csv
+int start_sampling(char *type_arg, char *input_name)
+{
+    if (sample_interval <= 0 && sample_file == NULL)
+        return 0;
+
+    char temp[512] = {0};
+    char *name = sample_file;
+    if (name == NULL)
+    {
+        strcat(temp, "output/samples-");
+        strcat(temp, type_arg);
+        strcat(temp, "-");
+        strcat(temp, input_name);
+        strcat(temp, ".csv");
+        name = temp;
+    }
+    return open_samples(name, sample_interval);
+}
+
+// Open the Gantt chart file output/gantt-<type>-<input>, and save its name in file_name
+int open_gantt(char *file_name, char *type_arg, char *input_name)
+{
+    mkdir("output", 0755);
+    strcat(file_name, "output/gantt-");
+    strcat(file_name, type_arg);
+    strcat(file_name, "-");
+    strcat(file_name, input_name);
+    gantt_file = fopen(file_name, "w");
+    if (gantt_file == NULL)
+    {
+        perror("fopen() error");
+        return -1;
+    }
+    return 0;
+}
+
+// Online mode
+// A reader thread admits each task when the clock reaches its arrival time, starting with slots slots
+int run_online(int scheduler_type, char *type_arg, char *input_file, char *input_name, int slots,
+               char *trace_file)
+{
+    printf("%s: Scheduler type: %d, online with %d slots\n", __func__, scheduler_type, slots);
+
+    struct reader_struct reader;
+    reader.fp = strcmp(input_file, "-") == 0 ? stdin : fopen(input_file, "r");
+    if (reader.fp == NULL)
+    {
+        perror("fopen() error");
+        return errno;
+    }
+
+    // Gantt chart is written out line by line, so it can be followed while the simulation runs
+    char temp[512] = {0};
+    if (open_gantt(temp, type_arg, input_name) != 0)
+        return errno;
+    setvbuf(gantt_file, NULL, _IOLBF, 0);
+
+    // One more slot for the reader
+    setup_scheduler(scheduler_type, slots + 1);
+    reader.tid = init_online();
+    if (trace_file != NULL && open_trace(trace_file) != 0)
+    {
+        return -EINVAL;
+    }
+    if (start_sampling(type_arg, input_name) != 0)
+    {
+        return -EINVAL;
+    }
+
+    if (thread_create(&reader.p_t, read_tasks, &reader))
+    {
+        fprintf(stderr, "%s: thread_create() error!\n", __func__);
+        return -EPERM;
+    }
+    if (thread_join(reader.p_t))
+    {
+        fprintf(stderr, "%s: thread_join() error!\n", __func__);
+        return -EPERM;
+    }
+
+    if (reader.fp != stdin)
+        fclose(reader.fp);
+    fclose(gantt_file);
+    close_trace();
+    close_samples();
+
+    print_report();
 
     printf("%s: Output file: %s\n", __func__, temp);
     printf("%s: Bye!\n", __func__);
     return 0;
 }
 
+// Reader starting point
+// Read one task at a time, and start its thread once it has arrived
+void *read_tasks(void *arg)
+{
+    struct reader_struct *reader = (struct reader_struct *)arg;
+    char buf[MAX_LINE_LEN];
+    int line_number = 0;
+
+    while (fgets(buf, MAX_LINE_LEN, reader->fp) != NULL)
+    {
+        line_number++;
+        buf[strcspn(buf, "\r\n")] = '\0'; // remove newline
+        float arrival_time;
+        int id;
+        if (sscanf(buf, "%f %d", &arrival_time, &id) != 2)
+        {
+            if (strspn(buf, "\t ") == strlen(buf))
+                // blank line
+                continue;
+            fprintf(stderr, "%s: line %d: invalid task: %s\n", __func__, line_number, buf);
+            exit(EXIT_FAILURE);
+        }
+
+        // the struct is freed by the task when it ends, so memory only holds running tasks
+        struct thread_struct *task = (struct thread_struct *)malloc(sizeof(*task));
+        if (!task)
+        {
+            perror("malloc() error");
+            exit(EXIT_FAILURE);
+        }
+        strncpy(task->line, buf, MAX_LINE_LEN);
+        task->id = id;
+        task->tid = admit_me(arrival_time, reader->tid, id);
+        if (thread_spawn(thread_start, task))
+        {
+            fprintf(stderr, "%s: thread_spawn() error!\n", __func__);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // no more arrivals, so time can run to the end of the last task
+    end_me(reader->tid);
+    wait_all_ended();
+    return NULL;
+}
+
 // Thread starting point
 // Independently read each line and call C/I/P/V/E
 void *thread_start(void *arg)
 {
     struct thread_struct *my_info = (struct thread_struct *)arg;
     int tid = my_info->tid;
+    int id = my_info->id;
 
     // read tokens
     char *token = NULL;
@@ -146,25 +451,87 @@ void *thread_start(void *arg)
     // the first operation (C/I/P/V) call from this thread is the arrival time in input file
     float schedule_time = arrival_time;
 
+    // deadline state set by D/T, applied to each following CPU burst
+    float relative_deadline = -1.0; // sticky relative deadline (D<n>)
+    float absolute_deadline = -1.0; // deadline for the next burst only (D@<n>)
+    float period = 0.0;             // period of job releases (T<n>)
+    float next_release = arrival_time;
+
     // tid
     token = strtok_r(NULL, delim, &saveptr);
-    if (tid != atoi(token))
+    if (id != atoi(token))
     {
-        fprintf(stderr, "%s: tid: %d, incorrect tid\n", __func__, tid);
+        fprintf(stderr, "%s: tid: %d, incorrect tid\n", __func__, id);
         exit(EXIT_FAILURE);
     }
 
+    // when resuming, operations before resume_op are only replayed for the D/T state
+    int op_index = 0;
+    int resume_op = -1;
+    int resume_remaining = 0;
+    float resume_time = schedule_time;
+    if (resuming)
+    {
+        resume_op = resume_cursor(tid, &resume_remaining, &resume_time);
+        if (resume_op < 0)
+            // this thread had already finished
+            return NULL;
+    }
+
     // loop until 'E'
     token = strtok_r(NULL, delim, &saveptr);
-    while (token)
+    for (; token; op_index++)
     {
         // save the return value (time) of C/I/P/V
         int ret_time = 0;
 
+        bool replay = op_index < resume_op;
+        if (op_index == resume_op)
+            schedule_time = resume_time;
+        else if (!replay)
+            cursor_me(tid, op_index);
+        if (replay && token[0] != 'C' && token[0] != 'D' && token[0] != 'T')
+        {
+            token = strtok_r(NULL, delim, &saveptr);
+            continue;
+        }
+
         // parse token
         if (token[0] == 'C')
         {
             int duration = atoi(&(token[1]));
+
+            // a periodic job is not released before its period starts
+            float release = schedule_time;
+            float deadline = -1.0;
+            if (period > 0)
+            {
+                if (schedule_time < next_release)
+                    schedule_time = next_release;
+                release = next_release;
+                deadline = next_release + (relative_deadline > 0 ? relative_deadline : period);
+                next_release += period;
+            }
+            else if (absolute_deadline >= 0)
+                deadline = absolute_deadline;
+            else if (relative_deadline > 0)
+                deadline = schedule_time + relative_deadline;
+            absolute_deadline = -1.0;
+
+            if (replay)
+            {
+                token = strtok_r(NULL, delim, &saveptr);
+                continue;
+            }
+            if (op_index == resume_op)
+            {
+                // the burst was already started, its deadline is in the checkpoint
+                schedule_time = resume_time;
+                duration = resume_remaining;
+            }
+            else if (deadline >= 0 && duration > 0)
+                deadline_me(tid, release, deadline, period);
+
             while (duration >= 0)
             {
                 ret_time = cpu_me(schedule_time, tid, duration);
@@ -173,7 +540,7 @@ void *thread_start(void *arg)
                     // only print when CPU is actually requested
                     // (if duration is 0, we are just notifying the scheduler)
                     // this tid had cpu from 'ret_time-1' to 'ret_time'
-                    fprintf(gantt_file, "%3d~%3d: T%d, CPU\n", ret_time - 1, ret_time, tid);
+                    fprintf(gantt_file, "%3d~%3d: T%d, CPU\n", ret_time - 1, ret_time, id);
 
                 // values for the next cpu_me() call
                 schedule_time = ret_time;
@@ -186,7 +553,7 @@ void *thread_start(void *arg)
             ret_time = io_me(schedule_time, tid, duration);
             // return from io_me()
             // this tid finished IO at time 'ret_time'
-            fprintf(gantt_file, "   ~%3d: T%d, Return from IO\n", ret_time, tid);
+            fprintf(gantt_file, "   ~%3d: T%d, Return from IO\n", ret_time, id);
         }
         else if (token[0] == 'P')
         {
@@ -194,7 +561,7 @@ void *thread_start(void *arg)
             ret_time = P(schedule_time, tid, sem_id);
             // return from P()
             // this tid finished P at time 'ret_time'
-            fprintf(gantt_file, "   ~%3d: T%d, Return from P%d\n", ret_time, tid, sem_id);
+            fprintf(gantt_file, "   ~%3d: T%d, Return from P%d\n", ret_time, id, sem_id);
         }
         else if (token[0] == 'V')
         {
@@ -202,7 +569,28 @@ void *thread_start(void *arg)
             ret_time = V(schedule_time, tid, sem_id);
             // return from V()
             // this tid finished V at time 'ret_time'
-            fprintf(gantt_file, "   ~%3d: T%d, Return from V%d\n", ret_time, tid, sem_id);
+            fprintf(gantt_file, "   ~%3d: T%d, Return from V%d\n", ret_time, id, sem_id);
+        }
+        else if (token[0] == 'D' || token[0] == 'T')
+        {
+            // D<n>: relative deadline of each following burst
+            // D@<n>: absolute deadline of the next burst
+            // T<n>: period, bursts are released every n from the arrival time
+            if (token[0] == 'T')
+                period = atof(&(token[1]));
+            else if (token[1] == '@')
+                absolute_deadline = atof(&(token[2]));
+            else
+                relative_deadline = atof(&(token[1]));
+            token = strtok_r(NULL, delim, &saveptr);
+            continue;
+        }
+        else if (token[0] == 'N')
+        {
+            // set the nice value used by CFS, takes no time
+            nice_me(tid, atoi(&(token[1])));
+            token = strtok_r(NULL, delim, &saveptr);
+            continue;
         }
         else if (token[0] == 'E')
         {
@@ -210,11 +598,13 @@ void *thread_start(void *arg)
             end_me(tid);
 
             // end this thread normally
+            if (streaming)
+                free(my_info);
             return NULL;
         }
         else
         {
-            fprintf(stderr, "%s: Error, tid: %d, invalid token: %c%c\n", __func__, tid, token[0], token[1]);
+            fprintf(stderr, "%s: Error, tid: %d, invalid token: %c%c\n", __func__, id, token[0], token[1]);
             exit(EXIT_FAILURE);
         }
 
@@ -226,10 +616,37 @@ void *thread_start(void *arg)
     }
     
     // No 'E' found in input file
-    fprintf(stderr, "%s: Error, tid: %d, thread finished without 'E' operation\n", __func__, tid);
+    fprintf(stderr, "%s: Error, tid: %d, thread finished without 'E' operation\n", __func__, id);
     exit(EXIT_FAILURE);
 }
 
+void print_usage()
+{
+    fprintf(stderr, "Usage: ./proj1 [options] <scheduler_type> <input_file>\n");
+    fprintf(stderr, "  Input file \"-\" is stdin, read online\n");
+    fprintf(stderr, "  Scheduler type: 0 - First Come, First Served\n");
+    fprintf(stderr, "  Scheduler type: 1 - Shortest Remaining Time First\n");
+    fprintf(stderr, "  Scheduler type: 2 - Multi-Level Feedback Queue\n");
+    fprintf(stderr, "  Scheduler type: 3 - Completely Fair Scheduler\n");
+    fprintf(stderr, "  Scheduler type: 4 - Earliest Deadline First\n");
+    fprintf(stderr, "  Scheduler type: 5 - Predictive Shortest Job First\n");
+    fprintf(stderr, "  -l <ticks>: CFS target latency (default 20)\n");
+    fprintf(stderr, "  -g <ticks>: CFS minimum granularity (default 4)\n");
+    fprintf(stderr, "  -a <alpha>: PSJF weight of the last burst in the estimate, from 0 to 1 (default 0.5)\n");
+    fprintf(stderr, "  -e <ticks>: PSJF estimate of a thread's first burst (default 5)\n");
+    fprintf(stderr, "  -x <ticks>: cost of each context switch (default 0)\n");
+    fprintf(stderr, "  -w <ticks>: most ticks to refill a cold cache after a switch (default 0)\n");
+    fprintf(stderr, "  -d <ticks>: time constant of a thread's cache going cold (default 10)\n");
+    fprintf(stderr, "  -t <file>: write the timeline as Chrome trace-event JSON\n");
+    fprintf(stderr, "  -p <ticks>: sample queue lengths and CPU state every ticks ticks\n");
+    fprintf(stderr, "  -P <file>: sample file (default output/samples-<scheduler_type>-<input>.csv)\n");
+    fprintf(stderr, "  -s <time>: save a checkpoint when the clock reaches time\n");
+    fprintf(stderr, "  -S <file>: checkpoint file (default output/checkpoint-<scheduler_type>-<input>)\n");
+    fprintf(stderr, "  -r <file>: resume from a checkpoint of the same scheduler type and input\n");
+    fprintf(stderr, "  -n <slots>: read tasks online as they arrive, into slots slots to start with (default %d for stdin)\n",
+            DEFAULT_ONLINE_SLOTS);
+}
+
 // From file_name, get the number of lines and do error check
 int get_line_count(char *file_name)
 {
@@ -0,0 +1,273 @@
+#ifdef PROFILE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "profile.h"
+
+#define PROF_MAX_STATS 16
+#define PROF_MAX_OBJECTS 64
+
+// A registered array of count locks or conds, size bytes apart
+struct prof_object {
+    const char *base;
+    size_t size;
+    int count;
+    struct prof_stats *stats;
+    long long *acquired_ns;  // When each lock was last acquired
+    long long *signaled_ns;  // When each cond was last signaled
+};
+
+static struct prof_stats stats[PROF_MAX_STATS];
+static int num_stats;
+static struct prof_object objects[PROF_MAX_OBJECTS];
+static int num_objects;
+
+// Locks and conds that were never registered
+static struct prof_stats *other_locks;
+static struct prof_stats *other_conds;
+
+// Wall time per simulated tick
+static long ticks;
+static long long tick_ns;
+static long long max_tick_ns;
+static long long last_tick_ns;
+
+static long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Counters are shared by every object with the same name, so update them atomically
+static void prof_add(long long *total, long long value)
+{
+    __atomic_fetch_add(total, value, __ATOMIC_RELAXED);
+}
+
+static void prof_count(long *count)
+{
+    __atomic_fetch_add(count, 1, __ATOMIC_RELAXED);
+}
+
+static void prof_max(long long *max, long long value)
+{
+    long long old = __atomic_load_n(max, __ATOMIC_RELAXED);
+    while (value > old && !__atomic_compare_exchange_n(max, &old, value, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+    }
+}
+
+static struct prof_stats *get_stats(const char *name, bool is_cond)
+{
+    for (int i = 0; i < num_stats; i++)
+    {
+        if (strcmp(stats[i].name, name) == 0)
+        {
+            return &stats[i];
+        }
+    }
+    if (num_stats == PROF_MAX_STATS)
+    {
+        return is_cond ? other_conds : other_locks;
+    }
+    stats[num_stats].name = name;
+    stats[num_stats].is_cond = is_cond;
+    return &stats[num_stats++];
+}
+
+// Find the object containing addr, and the index of addr in it
+static struct prof_object *find_object(const void *addr, int *index)
+{
+    const char *p = addr;
+    for (int i = 0; i < num_objects; i++)
+    {
+        struct prof_object *object = &objects[i];
+        if (p >= object->base && p < object->base + object->size * object->count &&
+            (p - object->base) % object->size == 0)
+        {
+            *index = (p - object->base) / object->size;
+            return object;
+        }
+    }
+    return NULL;
+}
+
+void prof_init()
+{
+    num_stats = 0;
+    num_objects = 0;
+    other_locks = get_stats("other locks", false);
+    other_conds = get_stats("other conds", true);
+    last_tick_ns = now_ns();
+    atexit(prof_report);
+}
+
+// Name count locks or conds laid out size bytes apart from base
+void prof_register(const void *base, size_t size, int count, const char *name, bool is_cond)
+{
+    if (num_objects == PROF_MAX_OBJECTS)
+    {
+        return;
+    }
+    struct prof_object *object = &objects[num_objects++];
+    object->base = base;
+    object->size = size;
+    object->count = count;
+    object->stats = get_stats(name, is_cond);
+    object->acquired_ns = calloc(count, sizeof(long long));
+    object->signaled_ns = calloc(count, sizeof(long long));
+}
+
+// Called by global_clock each time the simulated time advances
+void prof_tick()
+{
+    long long now = now_ns();
+    long long elapsed = now - last_tick_ns;
+    last_tick_ns = now;
+    ticks++;
+    tick_ns += elapsed;
+    if (elapsed > max_tick_ns)
+    {
+        max_tick_ns = elapsed;
+    }
+}
+
+int prof_mutex_lock(mutex_t *mutex)
+{
+    int index = 0;
+    struct prof_object *object = find_object(mutex, &index);
+    struct prof_stats *s = object ? object->stats : other_locks;
+
+    long long start = now_ns();
+    int ret = raw_mutex_trylock(mutex);
+    if (ret != 0)
+    {
+        ret = raw_mutex_lock(mutex);
+        prof_count(&s->contended);
+    }
+    long long acquired = now_ns();
+
+    prof_count(&s->count);
+    prof_add(&s->wait_ns, acquired - start);
+    prof_max(&s->max_wait_ns, acquired - start);
+    if (object)
+    {
+        object->acquired_ns[index] = acquired;
+    }
+    return ret;
+}
+
+// Account for the time since the lock was acquired
+static void end_hold(mutex_t *mutex)
+{
+    int index = 0;
+    struct prof_object *object = find_object(mutex, &index);
+    if (object)
+    {
+        long long held = now_ns() - object->acquired_ns[index];
+        prof_add(&object->stats->hold_ns, held);
+        prof_max(&object->stats->max_hold_ns, held);
+    }
+}
+
+int prof_mutex_unlock(mutex_t *mutex)
+{
+    end_hold(mutex);
+    return raw_mutex_unlock(mutex);
+}
+
+int prof_cond_wait(cond_t *cond, mutex_t *mutex)
+{
+    int index = 0;
+    struct prof_object *object = find_object(cond, &index);
+    struct prof_stats *s = object ? object->stats : other_conds;
+
+    // The mutex is released for the duration of the wait
+    end_hold(mutex);
+    long long start = now_ns();
+    int ret = raw_cond_wait(cond, mutex);
+    long long woken = now_ns();
+
+    int mutex_index = 0;
+    struct prof_object *mutex_object = find_object(mutex, &mutex_index);
+    if (mutex_object)
+    {
+        mutex_object->acquired_ns[mutex_index] = woken;
+    }
+
+    prof_count(&s->count);
+    prof_add(&s->wait_ns, woken - start);
+    prof_max(&s->max_wait_ns, woken - start);
+    if (object)
+    {
+        long long signaled = object->signaled_ns[index];
+        if (signaled >= start)
+        {
+            prof_count(&s->handoffs);
+            prof_add(&s->handoff_ns, woken - signaled);
+        }
+    }
+    return ret;
+}
+
+int prof_cond_signal(cond_t *cond)
+{
+    int index = 0;
+    struct prof_object *object = find_object(cond, &index);
+    struct prof_stats *s = object ? object->stats : other_conds;
+
+    prof_count(&s->signals);
+    if (object)
+    {
+        object->signaled_ns[index] = now_ns();
+    }
+    return raw_cond_signal(cond);
+}
+
+static double per(long long total, long count)
+{
+    return count > 0 ? (double)total / count : 0.0;
+}
+
+void prof_report()
+{
+    long long total_wait_ns = 0;
+
+    printf("Lock profile (times in us):\n");
+    printf("%-24s %10s %10s %10s %10s %10s %10s\n", "lock", "acquired", "contended",
+           "wait", "max wait", "hold", "max hold");
+    for (int i = 0; i < num_stats; i++)
+    {
+        struct prof_stats *s = &stats[i];
+        if (s->is_cond || s->count == 0)
+        {
+            continue;
+        }
+        total_wait_ns += s->wait_ns;
+        printf("%-24s %10ld %10ld %10.1f %10.1f %10.1f %10.1f\n", s->name, s->count, s->contended,
+               s->wait_ns / 1e3, s->max_wait_ns / 1e3, s->hold_ns / 1e3, s->max_hold_ns / 1e3);
+    }
+
+    printf("Handoff profile (times in us):\n");
+    printf("%-24s %10s %10s %10s %10s %10s %10s\n", "cond", "waits", "signals",
+           "wait", "max wait", "handoffs", "handoff");
+    for (int i = 0; i < num_stats; i++)
+    {
+        struct prof_stats *s = &stats[i];
+        if (!s->is_cond || (s->count == 0 && s->signals == 0))
+        {
+            continue;
+        }
+        printf("%-24s %10ld %10ld %10.1f %10.1f %10ld %10.1f\n", s->name, s->count, s->signals,
+               s->wait_ns / 1e3, s->max_wait_ns / 1e3, s->handoffs, s->handoff_ns / 1e3);
+    }
+
+    printf("Ticks: %ld, wall time per tick: %.1f us (max %.1f us), lock wait per tick: %.1f us\n",
+           ticks, per(tick_ns, ticks) / 1e3, max_tick_ns / 1e3, per(total_wait_ns, ticks) / 1e3);
+}
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "sync.h"
+
+/*
+Contention profiling of the simulator's own locks and condition variables.
+Built with -DPROFILE (make profile), every lock, unlock, wait and signal goes through
+the prof_ functions, which record acquisition counts, wait and hold times per lock and
+wait and signal-to-wakeup times per condition variable. The report is printed at exit.
+Without PROFILE the macros are the plain raw_ calls from sync.h.
+*/
+#ifdef PROFILE
+#define mutex_lock(mutex) prof_mutex_lock(mutex)
+#define mutex_unlock(mutex) prof_mutex_unlock(mutex)
+#define cond_wait(cond, mutex) prof_cond_wait(cond, mutex)
+#define cond_signal(cond) prof_cond_signal(cond)
+#else
+#define mutex_lock(mutex) raw_mutex_lock(mutex)
+#define mutex_unlock(mutex) raw_mutex_unlock(mutex)
+#define cond_wait(cond, mutex) raw_cond_wait(cond, mutex)
+#define cond_signal(cond) raw_cond_signal(cond)
+#define prof_init() ((void)0)
+#define prof_register(base, size, count, name, is_cond) ((void)0)
+#define prof_tick() ((void)0)
+#endif
+
+#ifdef PROFILE
+// Statistics shared by all objects registered under the same name
+struct prof_stats {
+    const char *name;
+    bool is_cond;
+    long count;              // Lock acquisitions, or condition waits
+    long contended;          // Lock acquisitions that had to wait
+    long long wait_ns;       // Time spent waiting to acquire, or blocked in the wait
+    long long max_wait_ns;
+    long long hold_ns;       // Time the lock was held
+    long long max_hold_ns;
+    long signals;            // Condition signals
+    long handoffs;           // Waits woken after a signal on the same condition
+    long long handoff_ns;    // Time from that signal to the waiter running
+};
+
+void prof_init();
+void prof_register(const void *base, size_t size, int count, const char *name, bool is_cond);
+void prof_tick();
+int prof_mutex_lock(mutex_t *mutex);
+int prof_mutex_unlock(mutex_t *mutex);
+int prof_cond_wait(cond_t *cond, mutex_t *mutex);
+int prof_cond_signal(cond_t *cond);
+void prof_report();
+#endif
+
+#endif
@@ -0,0 +1,88 @@
+#include <errno.h>
+
+#include "scheduler.h"
+
+static FILE *sample_file;
+static int sample_interval;
+
+// Start writing a sample to file_name every interval ticks
+int open_samples(char *file_name, int interval)
+{
+    sample_file = fopen(file_name, "w");
+    if (sample_file == NULL)
+    {
+        perror("fopen() error");
+        return -errno;
+    }
+    sample_interval = interval > 0 ? interval : 1;
+
+    fprintf(sample_file, "time");
+    if (schedule_type == 2)
+    {
+        for (int i = 0; i < 5; i++)
+        {
+            fprintf(sample_file, ",mlfq%d", i);
+        }
+    }
+    else
+    {
+        fprintf(sample_file, ",cpu");
+    }
+    fprintf(sample_file, ",io");
+    for (int i = 0; i < MAX_NUM_SEM; i++)
+    {
+        fprintf(sample_file, ",sem%d", i);
+    }
+    fprintf(sample_file, ",state\n");
+    return 0;
+}
+
+void close_samples()
+{
+    if (sample_file == NULL)
+    {
+        return;
+    }
+    fclose(sample_file);
+    sample_file = NULL;
+}
+
+// Called by global_clock after each tick's dispatch, with whether the CPU did anything
+void sample_tick(bool cpu_busy)
+{
+    if (sample_file == NULL || global_time % sample_interval != 0)
+    {
+        return;
+    }
+
+    fprintf(sample_file, "%d", global_time);
+    if (schedule_type == 2)
+    {
+        for (int i = 0; i < 5; i++)
+        {
+            fprintf(sample_file, ",%d", mlfq_queues[i].size);
+        }
+    }
+    else if (schedule_type == 3)
+    {
+        // A thread still inside its slice is runnable too, though not in the tree
+        fprintf(sample_file, ",%d", cfs_tree.count + (cfs_current != -1));
+    }
+    else
+    {
+        fprintf(sample_file, ",%d", cpu_queue.size);
+    }
+    fprintf(sample_file, ",%d", io_queue.size);
+    for (int i = 0; i < MAX_NUM_SEM; i++)
+    {
+        fprintf(sample_file, ",%d", semaphores[i].queue.size);
+    }
+
+    // A thread being switched to stays switch_tid until it runs
+    int state = SAMPLE_IDLE;
+    if (cpu_busy)
+    {
+        state = switch_tid != -1 ? SAMPLE_SWITCHING : SAMPLE_RUNNING;
+    }
+    fprintf(sample_file, ",%d\n", state);
+}
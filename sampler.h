@@ -0,0 +1,18 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stdbool.h>
+
+/*
+Time series of the simulator's load, written as CSV every SAMPLE interval ticks.
+Each row has the time, the number of threads waiting for the CPU (one column per
+MLFQ level under MLFQ), waiting for or doing I/O, and waiting in each semaphore,
+then what the CPU did in the tick that just ended: 0 idle, 1 running, 2 switching.
+*/
+#define SAMPLE_IDLE 0
+#define SAMPLE_RUNNING 1
+#define SAMPLE_SWITCHING 2
+
+void sample_tick(bool cpu_busy);
+
+#endif
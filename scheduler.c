@@ -7,22 +7,33 @@
 void init_priority_queue(struct priority_queue *queue)
 {
     queue->head = NULL;
-    pthread_mutex_init(&queue->mutex, NULL);
+    queue->tail = NULL;
+    queue->size = 0;
+    mutex_init(&queue->mutex);
 }
 
 // push to priority queue
 void push(struct priority_queue *queue, int tid, float priority1, float priority2)
 {
-    pthread_mutex_lock(&queue->mutex);
+    mutex_lock(&queue->mutex);
     struct priority_node *new_node = (struct priority_node *)malloc(sizeof(struct priority_node));
     new_node->tid = tid;
     new_node->priority1 = priority1;
     new_node->priority2 = priority2;
     new_node->next = NULL;
+    queue->size++;
 
     if (queue->head == NULL)
     {
         queue->head = new_node;
+        queue->tail = new_node;
+    }
+    else if (queue->tail->priority1 < priority1 ||
+             (queue->tail->priority1 == priority1 && queue->tail->priority2 <= priority2))
+    {
+        // Goes last, as most pushes do
+        queue->tail->next = new_node;
+        queue->tail = new_node;
     }
     else
     {
@@ -54,23 +65,32 @@ void push(struct priority_queue *queue, int tid, float priority1, float priority
             new_node->next = current;
             prev->next = new_node;
         }
+        if (current == NULL)
+        {
+            queue->tail = new_node;
+        }
     }
-    pthread_mutex_unlock(&queue->mutex);
+    mutex_unlock(&queue->mutex);
 }
 
 // pop from priority queue
 int pop(struct priority_queue *queue)
 {
-    pthread_mutex_t *mutex = &queue->mutex;
-    pthread_mutex_lock(mutex);
+    mutex_t *mutex = &queue->mutex;
+    mutex_lock(mutex);
     struct priority_node *node = queue->head;
     if (node == NULL)
     {
-        pthread_mutex_unlock(mutex);
+        mutex_unlock(mutex);
         return -1;
     }
     queue->head = node->next;
-    pthread_mutex_unlock(mutex);
+    queue->size--;
+    if (queue->head == NULL)
+    {
+        queue->tail = NULL;
+    }
+    mutex_unlock(mutex);
     int tid = node->tid;
     free(node);
     return tid;
@@ -78,15 +98,173 @@ int pop(struct priority_queue *queue)
 
 int peek(struct priority_queue *queue)
 {
-    pthread_mutex_t *mutex = &queue->mutex;
-    pthread_mutex_lock(mutex);
+    mutex_t *mutex = &queue->mutex;
+    mutex_lock(mutex);
     struct priority_node *node = queue->head;
     if (node == NULL)
     {
-        pthread_mutex_unlock(mutex);
+        mutex_unlock(mutex);
         return -1;
     }
-    pthread_mutex_unlock(mutex);
+    mutex_unlock(mutex);
+    return node->tid;
+}
+
+// initialize a red-black tree
+void init_rb_tree(struct rb_tree *tree)
+{
+    tree->root = NULL;
+    tree->count = 0;
+}
+
+static bool rb_is_red(struct rb_node *node)
+{
+    return node != NULL && node->red;
+}
+
+static bool rb_less(struct rb_node *a, struct rb_node *b)
+{
+    return a->key < b->key || (a->key == b->key && task_id[a->tid] < task_id[b->tid]);
+}
+
+static struct rb_node *rb_rotate_left(struct rb_node *h)
+{
+    struct rb_node *x = h->right;
+    h->right = x->left;
+    x->left = h;
+    x->red = h->red;
+    h->red = true;
+    return x;
+}
+
+static struct rb_node *rb_rotate_right(struct rb_node *h)
+{
+    struct rb_node *x = h->left;
+    h->left = x->right;
+    x->right = h;
+    x->red = h->red;
+    h->red = true;
+    return x;
+}
+
+static void rb_flip_colors(struct rb_node *h)
+{
+    h->red = !h->red;
+    h->left->red = !h->left->red;
+    h->right->red = !h->right->red;
+}
+
+// Restore the left-leaning invariants on the way back up
+static struct rb_node *rb_balance(struct rb_node *h)
+{
+    if (rb_is_red(h->right) && !rb_is_red(h->left))
+    {
+        h = rb_rotate_left(h);
+    }
+    if (rb_is_red(h->left) && rb_is_red(h->left->left))
+    {
+        h = rb_rotate_right(h);
+    }
+    if (rb_is_red(h->left) && rb_is_red(h->right))
+    {
+        rb_flip_colors(h);
+    }
+    return h;
+}
+
+static struct rb_node *rb_insert_node(struct rb_node *h, struct rb_node *node)
+{
+    if (h == NULL)
+    {
+        return node;
+    }
+    if (rb_less(node, h))
+    {
+        h->left = rb_insert_node(h->left, node);
+    }
+    else
+    {
+        h->right = rb_insert_node(h->right, node);
+    }
+    return rb_balance(h);
+}
+
+static struct rb_node *rb_delete_min(struct rb_node *h, struct rb_node **min)
+{
+    if (h->left == NULL)
+    {
+        *min = h;
+        return NULL;
+    }
+    // Borrow a red link from the right so the minimum is never a lone black node
+    if (!rb_is_red(h->left) && !rb_is_red(h->left->left))
+    {
+        rb_flip_colors(h);
+        if (rb_is_red(h->right->left))
+        {
+            h->right = rb_rotate_right(h->right);
+            h = rb_rotate_left(h);
+            rb_flip_colors(h);
+        }
+    }
+    h->left = rb_delete_min(h->left, min);
+    return rb_balance(h);
+}
+
+// insert into red-black tree, O(log n)
+void rb_insert(struct rb_tree *tree, int tid, long key)
+{
+    struct rb_node *new_node = (struct rb_node *)malloc(sizeof(struct rb_node));
+    new_node->key = key;
+    new_node->tid = tid;
+    new_node->red = true;
+    new_node->left = NULL;
+    new_node->right = NULL;
+
+    tree->root = rb_insert_node(tree->root, new_node);
+    tree->root->red = false;
+    tree->count++;
+}
+
+// pop the smallest (key, tid) from red-black tree, O(log n)
+int rb_pop_min(struct rb_tree *tree)
+{
+    if (tree->root == NULL)
+    {
+        return -1;
+    }
+    if (!rb_is_red(tree->root->left) && !rb_is_red(tree->root->right))
+    {
+        tree->root->red = true;
+    }
+    struct rb_node *min = NULL;
+    tree->root = rb_delete_min(tree->root, &min);
+    if (tree->root != NULL)
+    {
+        tree->root->red = false;
+    }
+    tree->count--;
+    int tid = min->tid;
+    free(min);
+    return tid;
+}
+
+// peek at the leftmost node, storing its key
+int rb_peek_min(struct rb_tree *tree, long *key)
+{
+    struct rb_node *node = tree->root;
+    if (node == NULL)
+    {
+        return -1;
+    }
+    while (node->left != NULL)
+    {
+        node = node->left;
+    }
+    if (key != NULL)
+    {
+        *key = node->key;
+    }
     return node->tid;
 }
 
@@ -102,13 +280,14 @@ void schedule_mlfq(struct priority_queue *queue, int tid, int arrival_time)
         if (consecutive_run_time[tid] + 1 >= time_quantum[level])
         {
             current_level[tid]++;
+            trace_level(tid, current_level[tid], global_time);
             // Reset consecutive run time if level is increased
             consecutive_run_time[tid] = 0;
         }
     }
 
     // Add the thread to the queue
-    push(&mlfq_queues[level], tid, arrival_time, tid);
+    push(&mlfq_queues[level], tid, arrival_time, task_id[tid]);
 }
 
 // Update consecutive run time and last run time
@@ -125,6 +304,86 @@ void update_mlfq_info(int tid)
     }
 }
 
+// Add a thread to the CFS timeline
+void schedule_cfs(int tid)
+{
+    // A thread that ran last tick keeps the CPU until its slice is used up
+    if (last_run_time[tid] == global_time && cfs_slice_run[tid] < cfs_slice[tid])
+    {
+        cfs_current = tid;
+        return;
+    }
+    cfs_slice_run[tid] = 0;
+
+    if (last_run_time[tid] != global_time)
+    {
+        if (cfs_vruntime[tid] < 0)
+        {
+            // New thread starts at the current minimum
+            cfs_vruntime[tid] = cfs_min_vruntime;
+        }
+        else
+        {
+            // Waking thread gets at most half a period of credit for sleeping
+            long floor = cfs_min_vruntime - (long)cfs_target_latency * CFS_NICE_0_LOAD / 2;
+            if (cfs_vruntime[tid] < floor)
+            {
+                cfs_vruntime[tid] = floor;
+            }
+        }
+    }
+
+    rb_insert(&cfs_tree, tid, cfs_vruntime[tid]);
+    cfs_load += cfs_weight[tid];
+}
+
+// Choose the thread to run this tick under CFS and charge it one tick
+int pick_cfs()
+{
+    int tid = cfs_current;
+    cfs_current = -1;
+
+    if (tid == -1)
+    {
+        tid = rb_pop_min(&cfs_tree);
+        if (tid == -1)
+        {
+            return -1;
+        }
+        cfs_load -= cfs_weight[tid];
+
+        // Stretch the period if the minimum granularity can't be met
+        int nr_running = cfs_tree.count + 1;
+        long period = cfs_target_latency;
+        if ((long)nr_running * cfs_min_granularity > period)
+        {
+            period = (long)nr_running * cfs_min_granularity;
+        }
+
+        // Slice is this thread's weighted share of the period
+        long slice = period * cfs_weight[tid] / (cfs_load + cfs_weight[tid]);
+        cfs_slice[tid] = fmax(slice, cfs_min_granularity);
+        cfs_slice_run[tid] = 0;
+    }
+
+    cfs_vruntime[tid] += (long)CFS_NICE_0_LOAD * CFS_NICE_0_LOAD / cfs_weight[tid];
+    cfs_slice_run[tid]++;
+
+    // min_vruntime only moves forward
+    long min_vruntime = cfs_vruntime[tid];
+    long leftmost;
+    if (rb_peek_min(&cfs_tree, &leftmost) != -1 && leftmost < min_vruntime)
+    {
+        min_vruntime = leftmost;
+    }
+    if (min_vruntime > cfs_min_vruntime)
+    {
+        cfs_min_vruntime = min_vruntime;
+    }
+    return tid;
+}
+
+// Ties are broken by the task id, which is the tid unless tasks are admitted online
 void schedule(struct priority_queue *queue, int scheduler_type, int tid, float arrival_time, int remaining_time)
 {
     float priority1 = 0.0;
@@ -133,31 +392,91 @@ void schedule(struct priority_queue *queue, int scheduler_type, int tid, float a
     {
     case 0: // FCFS
         priority1 = arrival_time;
-        priority2 = tid;
+        priority2 = task_id[tid];
         break;
     case 1: // SRTF
         priority1 = remaining_time;
-        priority2 = tid;
+        priority2 = task_id[tid];
         break;
     case 2: // MLFQ
         schedule_mlfq(queue, tid, arrival_time);
         return;
+    case 3: // CFS
+        schedule_cfs(tid);
+        return;
+    case 4: // EDF
+        // Threads without a deadline only run when no deadline is pending
+        priority1 = job_deadline[tid] >= 0 ? job_deadline[tid] : INFINITY;
+        priority2 = task_id[tid];
+        break;
+    case 5: // PSJF
+        // Estimated remaining time, from what the thread has run of its burst so far
+        priority1 = fmax(burst_estimate[tid] - burst_run[tid], 0.0);
+        priority2 = task_id[tid];
+        break;
     }
     push(queue, tid, priority1, priority2);
 }
 
-bool all_active()
+// Account for a CPU burst with a deadline that finished at finish_time
+void record_deadline(int tid, float finish_time)
 {
-    // Count the number of active threads
-    int count = 0;
-    for (int i = 0; i < num_threads; i++)
+    struct deadline_stats *stats = &deadline_stats[tid];
+    float lateness = finish_time - job_deadline[tid];
+
+    stats->jobs++;
+    stats->lateness_sum += lateness;
+    if (stats->jobs == 1 || lateness > stats->lateness_max)
     {
-        if (active[i])
+        stats->lateness_max = lateness;
+    }
+
+    int bucket = 0;
+    if (lateness > 0)
+    {
+        stats->misses++;
+        bucket = 1;
+        for (float bound = 1; lateness > bound && bucket < DEADLINE_BUCKETS - 1; bound *= 2)
         {
-            count++;
+            bucket++;
         }
     }
-    return count == threads_remaining;
+    stats->lateness_hist[bucket]++;
+
+    if (stats->burst > stats->wcet)
+    {
+        stats->wcet = stats->burst;
+    }
+
+    // A periodic job must also be done before the next one is released
+    float window = job_deadline[tid] - job_release[tid];
+    if (stats->period > 0 && stats->period < window)
+    {
+        window = stats->period;
+    }
+    if (window > 0 && stats->burst / window > stats->density)
+    {
+        stats->density = stats->burst / window;
+    }
+
+    job_release[tid] = -1.0;
+    job_deadline[tid] = -1.0;
+}
+
+// Mark a thread as active (it has asked for its next operation) or not
+void set_active(int tid, bool value)
+{
+    // Only the thread itself changes its flag, but P does so without worker_mutex
+    if (active[tid] != value)
+    {
+        active[tid] = value;
+        __atomic_add_fetch(&active_count, value ? 1 : -1, __ATOMIC_SEQ_CST);
+    }
+}
+
+bool all_active()
+{
+    return __atomic_load_n(&active_count, __ATOMIC_SEQ_CST) == threads_remaining;
 }
 
 // If there's at least one thread in cpu_queue, signal the cpu
@@ -165,23 +484,29 @@ bool signal_cpu()
 {
     int tid_to_run = -1;
 
+    // A switch that was started runs to the end before anything else is picked
+    if (switch_tid != -1)
+    {
+        tid_to_run = switch_tid;
+    }
     // If it's MLFQ, check the queues from level 0 to 3
-    if (schedule_type == 2)
+    else if (schedule_type == 2)
     {
         for (int i = 0; i < 4; i++)
         {
             tid_to_run = peek(&mlfq_queues[i]);
             if (tid_to_run != -1)
             {
-                // Update last run time
-                last_run_time[tid_to_run] = global_time;
-
                 // Pop it
                 pop(&mlfq_queues[i]);
                 break;
             }
         }
     }
+    else if (schedule_type == 3)
+    {
+        tid_to_run = pick_cfs();
+    }
     else
     {
         tid_to_run = peek(&cpu_queue);
@@ -192,33 +517,109 @@ bool signal_cpu()
         }
     }    
 
-    // If there's at least one thread in cpu_queue, signal the cpu
-    if (tid_to_run != -1)
+    if (tid_to_run == -1)
     {
-        pthread_cond_signal(&thread_run_conds[tid_to_run]);
-        pthread_cond_wait(&ready, &worker_mutex);
+        return 0;
+    }
+
+    // Switching to another thread first costs ticks in which it doesn't run yet
+    if (switch_tid == -1 && tid_to_run != cpu_last_tid)
+    {
+        switches++;
+        cpu_last_tid = tid_to_run;
+        switch_left = switch_cost_to(tid_to_run);
+        if (switch_left > 0)
+        {
+            switch_tid = tid_to_run;
+            trace_switch(tid_to_run, global_time - 1, switch_left);
+        }
+    }
+    if (switch_left > 0)
+    {
+        switch_left--;
+        fprintf(gantt_file, "%3d~%3d: T%d, Context switch\n", global_time - 1, global_time, task_id[tid_to_run]);
         return 1;
     }
-    return 0;
+    switch_tid = -1;
+
+    // Update last run time
+    last_run_time[tid_to_run] = global_time;
+    last_dispatch[tid_to_run] = global_time;
+    burst_run[tid_to_run]++;
+    cpu_run_ticks++;
+
+    // Signal the cpu
+    trace_cpu(tid_to_run, global_time);
+    cond_signal(thread_run_conds[tid_to_run]);
+    cond_wait(&ready, &worker_mutex);
+    return 1;
+}
+
+// Burst is over, so check it against its estimate and update the estimate
+void record_burst(int tid)
+{
+    int burst = burst_run[tid];
+    burst_run[tid] = 0;
+    if (burst == 0)
+    {
+        return;
+    }
+
+    float error = burst - burst_estimate[tid];
+    predictions++;
+    prediction_error += error;
+    prediction_abs_error += fabs(error);
+    if (fabs(error) > prediction_max_error)
+    {
+        prediction_max_error = fabs(error);
+    }
+    burst_estimate[tid] = psjf_alpha * burst + (1 - psjf_alpha) * burst_estimate[tid];
+}
+
+// Ticks it costs the CPU to switch to tid: the fixed switch cost, plus refilling tid's
+// cache, which has gone colder the longer ago tid last ran
+int switch_cost_to(int tid)
+{
+    int cost = switch_cost;
+    if (cache_penalty > 0)
+    {
+        float cold = 1.0;
+        if (last_dispatch[tid] >= 0)
+        {
+            // Ticks between the one it last ran in and this one
+            int gap = global_time - 1 - last_dispatch[tid];
+            cold = 1.0 - exp(-gap / cache_decay);
+        }
+        int refill = lround(cache_penalty * cold);
+        cache_ticks += refill;
+        cost += refill;
+    }
+    switch_ticks += switch_cost;
+    return cost;
 }
 
 bool signal_io()
 {
     if (io_queue.head != NULL)
     {
-        // Calculate when the top thread should finish
+        // Calculate when the top thread should finish, once per thread
         // Top thread is always the correct one to run since it is FCFS
         int tid = peek(&io_queue);
-        float top_priority = io_queue.head->priority1;
-        int end_time = fmax(io_end_time, top_priority) + io_durations[tid];
+        if (io_head_end == -1)
+        {
+            io_head_start = fmax(io_end_time, io_queue.head->priority1);
+            io_head_end = io_head_start + io_durations[tid];
+        }
 
         // If it is time to run, signal the thread to finish
-        if (end_time <= global_time)
+        if (io_head_end <= global_time)
         {
-            io_end_time = end_time;
+            trace_io(tid, io_head_start, io_head_end);
+            io_end_time = io_head_end;
+            io_head_end = -1;
 
-            pthread_cond_signal(&thread_run_conds[pop(&io_queue)]);
-            pthread_cond_wait(&ready, &worker_mutex);
+            cond_signal(thread_run_conds[pop(&io_queue)]);
+            cond_wait(&ready, &worker_mutex);
             return 1;
         }
     }
@@ -229,24 +630,46 @@ bool signal_io()
 void wait_until_turn(int tid, float time)
 {
     // Set the thread to be active
-    active[tid] = true;
+    set_active(tid, true);
 
-    // Add this as a waiting thread
-    push(&threads_waiting, tid, time, 0.0);
+    // Add this as a waiting thread, to the timing wheel unless it is already due
+    if (time <= global_time)
+    {
+        push(&threads_waiting, tid, time, 0.0);
+    }
+    else
+    {
+        wheel_add(&wakeup_wheel, tid, time);
+    }
 
     // If all threads are active, run the global clock
     if (all_active())
     {
-        /*
-        Need global clock to run simultaneously to the current thread's action
-        so we create a new thread that will run global_clock.
-        */
-        pthread_t global_clock_thread;
-        pthread_create(&global_clock_thread, NULL, &threadFunc, NULL);
+        start_clock();
     }
 
     // Wait for this thread to be called
-    pthread_cond_wait(&thread_wakeup_conds[tid], &worker_mutex);
+    cond_wait(thread_wakeup_conds[tid], &worker_mutex);
+}
+
+// Has a resumed thread that is already in a restored queue wait until it is run
+void park_until_run(int tid)
+{
+    set_active(tid, true);
+    if (all_active())
+    {
+        start_clock();
+    }
+    cond_wait(thread_run_conds[tid], &worker_mutex);
+}
+
+void start_clock()
+{
+    /*
+    Need global clock to run simultaneously to the current thread's action
+    so we create a new thread that will run global_clock.
+    */
+    thread_spawn(&threadFunc, NULL);
 }
 
 // Thread initialization function that simply calls the global_clock
@@ -258,8 +681,8 @@ void *threadFunc(void *arg)
 // Main function loops global time and calls the threads
 void global_clock()
 {
-    pthread_mutex_lock(&process_mutex); // Lock threads out of being processed
-    pthread_mutex_lock(&worker_mutex);  // Lock threads out of doing work
+    mutex_lock(&process_mutex); // Lock threads out of being processed
+    mutex_lock(&worker_mutex);  // Lock threads out of doing work
 
     /*
     Loop until some thread is inactive (or the program ends), since global_clock is only run
@@ -267,24 +690,36 @@ void global_clock()
     */
     while (all_active() && threads_remaining > 0)
     {
+        // Every thread is blocked in a known place, so the state can be saved
+        if (checkpoint_time >= 0 && global_time >= checkpoint_time)
+        {
+            if (save_checkpoint(checkpoint_file) == 0)
+            {
+                printf("%s: Saved checkpoint at time %d to %s\n", __func__, global_time, checkpoint_file);
+            }
+            checkpoint_time = -1;
+        }
+
         // Signal all waiting threads that it is time for them to be processed
+        wheel_advance(&wakeup_wheel, global_time, &threads_waiting);
         while (threads_waiting.head != NULL && threads_waiting.head->priority1 <= global_time)
         {
-            pthread_cond_signal(&thread_wakeup_conds[pop(&threads_waiting)]);
+            cond_signal(thread_wakeup_conds[pop(&threads_waiting)]);
             // Wait until thread signals it is done processing.
-            pthread_cond_wait(&ready, &worker_mutex);
+            cond_wait(&ready, &worker_mutex);
         }
 
         // Never make decisions if some data isn't arrived
         if (all_active())
         {
             global_time++; // Time is integral, so next action must come at least 1 later
+            prof_tick();
             signal_io();
-            signal_cpu();
+            sample_tick(signal_cpu());
         }
     }
-    pthread_mutex_unlock(&worker_mutex);
-    pthread_mutex_unlock(&process_mutex);
+    mutex_unlock(&worker_mutex);
+    mutex_unlock(&process_mutex);
 }
 
 // Debugging purposes only
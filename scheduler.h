@@ -6,23 +6,30 @@
 #include <stdbool.h>
 #include <math.h>
 #include <limits.h>
-#include <pthread.h>
 
 #include "interface.h"
+#include "sync.h"
+#include "profile.h"
+#include "trace.h"
+#include "sampler.h"
+
+// Lateness histogram: met, then (0,1], (1,2], (2,4], (4,8], (8,16], (16,inf)
+#define DEADLINE_BUCKETS 7
 
 // Global variables
-int schedule_type;                     // The type of scheduler (0 = FCFS, 1 = SRTF, 2 = MLFQ)
+int schedule_type;                     // The type of scheduler (0 = FCFS, 1 = SRTF, 2 = MLFQ, 3 = CFS, 4 = EDF, 5 = PSJF)
 struct priority_queue cpu_queue;       // Priority queue for CPU calls
 struct priority_queue io_queue;        // Priority queue for I/O calls
-struct priority_queue threads_waiting; // Priority queue for waiting threads
+struct priority_queue threads_waiting; // Priority queue for waiting threads due by the current tick
 struct semaphore *semaphores;          // Array of semaphores
 bool *active;                          // Array of active threads
+int active_count;                      // Number of active threads
 bool io_active;
 int global_time;                       // Global time variable
-pthread_mutex_t worker_mutex;                 // mutex variable
-pthread_mutex_t process_mutex;                 // mutex variable
+mutex_t worker_mutex;                 // mutex variable
+mutex_t process_mutex;                 // mutex variable
 
-pthread_mutex_t semaphore_mutex;                 // mutex variable
+mutex_t semaphore_mutex;                 // mutex variable
 
 int num_threads;                       // The total number of threads
 int threads_remaining;                 // The number of threads remaining
@@ -30,12 +37,12 @@ int threads_remaining;                 // The number of threads remaining
 int io_end_time;                    
 int *io_durations;
 
-pthread_cond_t *thread_wakeup_conds;             // Array of pthread conds
-pthread_cond_t *thread_run_conds;             // Array of pthread conds
-pthread_cond_t ready;             // Array of pthread conds
+cond_t **thread_wakeup_conds;            // Array of conds (each slot's cond never moves)
+cond_t **thread_run_conds;               // Array of conds
+cond_t ready;             // Array of conds
 
-pthread_cond_t semaphore_cond;         // Semaphore pthread cond
-pthread_cond_t all_active_cond;        // All active pthread cond
+cond_t semaphore_cond;         // Semaphore cond
+cond_t all_active_cond;        // All active cond
 float *cpu_arrival_times;              // Array of thread arrival times at the CPU
 
 // consecutive run time array
@@ -53,6 +60,107 @@ struct priority_queue *mlfq_queues;
 // The time quantum for the 5 levels is 5, 10, 15, 20
 int *time_quantum;
 
+// CFS load weight of each thread (derived from its nice value)
+int *cfs_weight;
+
+// CFS virtual runtime of each thread (a nice 0 thread gains CFS_NICE_0_LOAD per tick)
+long *cfs_vruntime;
+
+// CFS slice length and ticks already run in the current slice
+int *cfs_slice;
+int *cfs_slice_run;
+
+// Thread that is still inside its slice, so it bypasses the tree (-1 if none)
+int cfs_current;
+long cfs_min_vruntime;                 // Monotonic floor for vruntimes of waking threads
+long cfs_load;                         // Sum of weights of the threads in cfs_tree
+int cfs_target_latency;                // Period in which every runnable thread should run once
+int cfs_min_granularity;               // Smallest slice a thread is given
+
+// Release time and absolute deadline of each thread's current CPU burst (-1 if it has none)
+float *job_release;
+float *job_deadline;
+
+// Per-thread deadline accounting
+struct deadline_stats {
+    float period;         // Period declared by the thread (0 if aperiodic)
+    int burst;            // Length of the current burst
+    int wcet;             // Longest burst completed
+    int jobs;             // Bursts completed with a deadline
+    int misses;           // Bursts completed after their deadline
+    float lateness_sum;
+    float lateness_max;
+    float density;        // Largest burst / min(deadline - release, period) seen
+    int lateness_hist[DEADLINE_BUCKETS];
+};
+struct deadline_stats *deadline_stats;
+
+// Checkpoint: time at which to save the simulation (-1 if never) and where
+int checkpoint_time;
+char *checkpoint_file;
+
+// Whether each thread has called end_me
+bool *ended;
+
+// Index of the input operation each thread is in, and the remaining_time of its last cpu_me
+int *op_cursor;
+int *cpu_remaining;
+
+// Where each thread was when the checkpoint it is resumed from was saved
+enum resume_state {
+    RESUME_NONE = 0,      // Not resuming (or already resumed)
+    RESUME_WAITING = 1,   // Waiting for its operation's time, so it calls the operation again
+    RESUME_QUEUED = 2,    // In a CPU or I/O queue that was restored, so it waits to be run
+    RESUME_SEMAPHORE = 3, // In a semaphore queue that was restored, so it waits for V
+    RESUME_ENDED = 4,     // Already finished
+};
+enum resume_state *resume_state;
+float *resume_time;                    // Time to call the operation again at (RESUME_WAITING)
+
+// Online mode: tasks are admitted into free slots as they arrive, and their slots reused once they end
+bool online;
+int reader_tid;                        // Slot of the thread reading and admitting tasks
+int *free_slots;                       // Stack of slots no task is using
+int num_free_slots;
+cond_t all_ended_cond;                 // Signaled when the last thread ends
+
+// Task id from the input of the task in each slot (the slot itself unless online)
+int *task_id;
+
+// Context switch cost model: ticks in which the CPU runs nothing while it switches threads
+int switch_cost;                       // Fixed ticks per switch
+int cache_penalty;                     // Most ticks to refill the cache of a thread that went cold
+float cache_decay;                     // Time constant, in ticks, of a thread's cache going cold
+int cpu_last_tid;                      // Thread the CPU last ran or switched to (-1 if none)
+int switch_tid;                        // Thread the CPU is switching to (-1 if none)
+int switch_left;                       // Ticks left in that switch
+int *last_dispatch;                    // Last tick each thread ran on the CPU (-1 if never)
+long switches;                         // Number of switches
+long switch_ticks;                     // Ticks lost to the fixed switch cost
+long cache_ticks;                      // Ticks lost to cache refills
+long cpu_run_ticks;                    // Ticks threads ran on the CPU
+
+extern FILE *gantt_file;
+
+// Predictive SJF: each thread's next CPU burst is estimated from its past bursts by
+// exponential averaging, estimate = alpha * last burst + (1 - alpha) * estimate
+float psjf_alpha;
+float psjf_initial_estimate;           // Estimate of a thread's first burst
+float *burst_estimate;                 // Estimated length of each thread's current burst
+int *burst_run;                        // Ticks each thread has run in its current burst
+long predictions;                      // Bursts completed, with their prediction errors
+double prediction_abs_error;
+double prediction_error;
+float prediction_max_error;
+
+#define CACHE_DEFAULT_DECAY 10.0
+#define PSJF_DEFAULT_ALPHA 0.5
+#define PSJF_DEFAULT_INITIAL_ESTIMATE 5.0
+
+#define CFS_NICE_0_LOAD 1024
+#define CFS_DEFAULT_TARGET_LATENCY 20
+#define CFS_DEFAULT_MIN_GRANULARITY 4
+
 
 // Declare your own data structures and functions here...
 // Priority queue of condition variables
@@ -65,7 +173,49 @@ struct priority_node {
 
 struct priority_queue {
     struct priority_node *head;
-    pthread_mutex_t mutex;
+    struct priority_node *tail;  // Last node, so pushes in order don't walk the list
+    int size;                    // Number of nodes
+    mutex_t mutex;
+};
+
+// Hierarchical timing wheel of pending wakeups (see wheel.c)
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)   // Slots per level
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4                 // Slots of level n are WHEEL_SIZE^n ticks wide
+
+struct wheel_timer {
+    float time;                        // Time the thread wakes at
+    long expires;                      // Tick the timer expires on
+    int tid;
+    unsigned long seq;                 // Order timers were added in, to break ties in time
+    struct wheel_timer *next;
+};
+
+struct wheel_slot {
+    struct wheel_timer *head;
+    struct wheel_timer *tail;
+};
+
+struct timer_wheel {
+    long next;                         // Next tick to run
+    unsigned long seq;
+    struct wheel_slot slots[WHEEL_LEVELS][WHEEL_SIZE];
+    struct wheel_slot overflow;        // Timers beyond the last level
+};
+
+// Red-black tree ordered by (key, tid), used as the CFS timeline
+struct rb_node {
+    long key;
+    int tid;
+    bool red;
+    struct rb_node *left;
+    struct rb_node *right;
+};
+
+struct rb_tree {
+    struct rb_node *root;
+    int count;
 };
 
 // Semaphore struct
@@ -74,19 +224,46 @@ struct semaphore {
     struct priority_queue queue;
 };
 
+struct rb_tree cfs_tree;               // Runnable CFS threads ordered by vruntime
+struct timer_wheel wakeup_wheel;       // Threads waiting for a time after the current tick
+
+// Completion time of the thread at the head of io_queue, worked out when the head changes (-1 if not yet)
+int io_head_end;
+double io_head_start;
+
 void schedule_mlfq(struct priority_queue *queue, int tid, int arrival_time);
 void update_mlfq_info(int tid);
+void schedule_cfs(int tid);
+int pick_cfs();
+void record_deadline(int tid, float finish_time);
+void record_burst(int tid);
+void report_deadline(int tid);
+void reset_thread(int tid);
+void init_rb_tree(struct rb_tree *tree);
+void rb_insert(struct rb_tree *tree, int tid, long key);
+int rb_pop_min(struct rb_tree *tree);
+int rb_peek_min(struct rb_tree *tree, long *key);
+void init_wheel(struct timer_wheel *wheel, long now);
+void wheel_add(struct timer_wheel *wheel, int tid, float time);
+void wheel_advance(struct timer_wheel *wheel, long tick, struct priority_queue *due);
+bool wheel_find(struct timer_wheel *wheel, int tid, float *time);
 void init_priority_queue(struct priority_queue *queue);
 void push(struct priority_queue *queue, int tid, float priority1, float priority2);
 int pop(struct priority_queue *queue);
 int peek(struct priority_queue *queue);
 void print_queue(struct priority_queue *queue);
 void schedule(struct priority_queue *queue, int scheduler_type, int tid, float arrival_time, int remaining_time);
+void set_active(int tid, bool value);
 bool all_active();
+int switch_cost_to(int tid);
 bool signal_cpu();
 bool signal_io();
 void wait_until_turn(int tid, float time);
+void park_until_run(int tid);
+void start_clock();
 void * threadFunc(void * arg);
+int save_checkpoint(const char *file_name);
+int load_checkpoint(const char *file_name);
 void global_clock();
 #endif
 
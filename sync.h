@@ -0,0 +1,56 @@
+#ifndef SYNC_H
+#define SYNC_H
+
+#include <pthread.h>
+
+/*
+Threads, mutexes and condition variables the simulator runs on: pthreads by default,
+or coroutines when built with -DCOROUTINE (make coro). Locking goes through the
+mutex_lock/cond_wait macros in profile.h, which use the raw_ operations below.
+*/
+#ifdef COROUTINE
+#include "coroutine.h"
+
+typedef struct coroutine *thread_t;
+typedef struct co_mutex mutex_t;
+typedef struct co_cond cond_t;
+
+#define thread_create(thread, func, arg) co_create(thread, func, arg, false)
+#define thread_spawn(func, arg) co_create(NULL, func, arg, true)
+#define thread_join(thread) co_join(thread)
+#define mutex_init(mutex) co_mutex_init(mutex)
+#define cond_init(cond) co_cond_init(cond)
+#define raw_mutex_lock(mutex) co_mutex_lock(mutex)
+#define raw_mutex_trylock(mutex) co_mutex_trylock(mutex)
+#define raw_mutex_unlock(mutex) co_mutex_unlock(mutex)
+#define raw_cond_wait(cond, mutex) co_cond_wait(cond, mutex)
+#define raw_cond_signal(cond) co_cond_signal(cond)
+#else
+typedef pthread_t thread_t;
+typedef pthread_mutex_t mutex_t;
+typedef pthread_cond_t cond_t;
+
+#define thread_create(thread, func, arg) pthread_create(thread, NULL, func, arg)
+#define thread_join(thread) pthread_join(thread, NULL)
+#define mutex_init(mutex) pthread_mutex_init(mutex, NULL)
+#define cond_init(cond) pthread_cond_init(cond, NULL)
+#define raw_mutex_lock(mutex) pthread_mutex_lock(mutex)
+#define raw_mutex_trylock(mutex) pthread_mutex_trylock(mutex)
+#define raw_mutex_unlock(mutex) pthread_mutex_unlock(mutex)
+#define raw_cond_wait(cond, mutex) pthread_cond_wait(cond, mutex)
+#define raw_cond_signal(cond) pthread_cond_signal(cond)
+
+// Start a thread nobody joins
+static inline int thread_spawn(void *(*func)(void *), void *arg)
+{
+    pthread_t thread;
+    int ret = pthread_create(&thread, NULL, func, arg);
+    if (ret == 0)
+    {
+        pthread_detach(thread);
+    }
+    return ret;
+}
+#endif
+
+#endif
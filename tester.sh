@@ -1,16 +1,124 @@
 #!/bin/bash
+# Number of times each case is run, since thread interleavings differ from run to run
+runs=${RUNS:-1000}
+# Program under test (the coroutine build when this script runs itself again below)
+proj1=${PROJ1:-./proj1}
+
 function diffs() {
     diff "${@:3}" <(sort sample_output/gantt-"$1"-input_"$2") <(sort output/gantt-"$1"-input_"$2"); 
 }
 
+function custom_diffs() {
+    diff <(sort custom_output/gantt-"$1"-input_"$2") <(sort output/gantt-"$1"-input_"$2");
+}
+
 for cpu_type in {0..2}; do
     for sample_input_num in {0..11}; do
         # Output sample_input_num and cpu_type
         echo "Testing sample input $sample_input_num with cpu type $cpu_type"
-        for i in {1..1000}; do
+        for i in $(seq "$runs"); do
             # don't allow proj1 to output to stdout
-            ./proj1 "$cpu_type" sample_input/input_"$sample_input_num" > /dev/null
+            "$proj1" "$cpu_type" sample_input/input_"$sample_input_num" > /dev/null
             diffs "$cpu_type" "$sample_input_num"
         done
     done
 done
+
+# CFS, EDF and PSJF on the custom inputs (j has nice values, k deadlines and periods, l bursts that vary,
+# n deadlines longer than periods)
+for cpu_type in {3..5}; do
+    for custom_input in {a..l} n; do
+        echo "Testing custom input $custom_input with cpu type $cpu_type"
+        for i in $(seq "$runs"); do
+            "$proj1" "$cpu_type" custom_input/input_"$custom_input" > /dev/null
+            custom_diffs "$cpu_type" "$custom_input"
+            # Online, starting from a single slot so the slots have to grow (needs lines in order of arrival)
+            if sort -g -c -k1,1 custom_input/input_"$custom_input" 2> /dev/null; then
+                "$proj1" -n 1 "$cpu_type" custom_input/input_"$custom_input" > /dev/null
+                custom_diffs "$cpu_type" "$custom_input"
+            fi
+        done
+    done
+done
+
+# Deadline report of EDF, with aperiodic tasks on input k and an overloaded periodic set on input n
+for custom_input in k n; do
+    echo "Testing deadline report of custom input $custom_input"
+    for i in $(seq "$runs"); do
+        "$proj1" 4 custom_input/input_"$custom_input" | sed -n '/^Deadlines:/,/EDF schedulable/p' |
+            diff custom_output/report-4-input_"$custom_input" -
+    done
+done
+
+# Context switch cost, on input m
+for cpu_type in {0..5}; do
+    echo "Testing custom input m with context switch cost and cpu type $cpu_type"
+    for i in $(seq "$runs"); do
+        "$proj1" -x 1 -w 3 "$cpu_type" custom_input/input_m > /dev/null
+        custom_diffs "$cpu_type" m
+    done
+done
+
+# Save a checkpoint of input $2 under cpu type $1 at time $3 and resume from it. The resumed Gantt chart must
+# have the lines of the full run's chart $4 that end after the checkpoint, and no line that isn't in it
+# (events at the checkpoint tick itself, like returns from V, can happen before or after it is saved)
+function checkpoint_diffs() {
+    "$proj1" -s "$3" -S output/checkpoint-test "$1" "$2" > /dev/null
+    "$proj1" -r output/checkpoint-test "$1" "$2" > /dev/null
+    local resumed=output/gantt-"$1"-"$(basename "$2")"
+    diff <(awk -F'[~:]' -v t="$3" '$2 + 0 > t' "$4" | sort) <(awk -F'[~:]' -v t="$3" '$2 + 0 > t' "$resumed" | sort)
+    comm -13 <(sort "$4") <(sort "$resumed")
+}
+
+for cpu_type in {3..5}; do
+    for custom_input in {j..l}; do
+        echo "Testing checkpoint of custom input $custom_input with cpu type $cpu_type"
+        for i in $(seq "$runs"); do
+            checkpoint_diffs "$cpu_type" custom_input/input_"$custom_input" 10 \
+                custom_output/gantt-"$cpu_type"-input_"$custom_input"
+        done
+    done
+done
+
+# Checkpoints at a tick with semaphore returns
+for cpu_type in 0 {3..5}; do
+    echo "Testing checkpoint of custom input f with cpu type $cpu_type"
+    for i in $(seq "$runs"); do
+        checkpoint_diffs "$cpu_type" custom_input/input_f 8 custom_output/gantt-"$cpu_type"-input_f
+    done
+done
+echo "Testing checkpoint of sample input 2 with cpu type 1"
+for i in $(seq "$runs"); do
+    checkpoint_diffs 1 sample_input/input_2 5 sample_output/gantt-1-input_2
+done
+rm -f output/checkpoint-test
+
+# Load samples of input m with context switch cost, with a column per level under MLFQ and one under CFS
+for cpu_type in 2 3; do
+    echo "Testing load samples of custom input m with cpu type $cpu_type"
+    for i in $(seq "$runs"); do
+        "$proj1" -x 1 -w 3 -p 1 -P output/samples-test.csv "$cpu_type" custom_input/input_m > /dev/null
+        diff custom_output/samples-"$cpu_type"-input_m.csv output/samples-test.csv
+    done
+done
+rm -f output/samples-test.csv
+
+# Trace export of sample input 10 under MLFQ with switch costs, which has CPU, I/O, semaphore, MLFQ and
+# switch events: it must be valid JSON with as many events in each category as the golden
+echo "Testing trace export of sample input 10"
+for i in $(seq "$runs"); do
+    "$proj1" -x 1 -w 3 -t output/trace-test.json 2 sample_input/input_10 > /dev/null
+    python3 -m json.tool output/trace-test.json > /dev/null
+    python3 -c 'import collections, json, sys
+counts = collections.Counter(event.get("cat", event["ph"]) for event in json.load(sys.stdin)["traceEvents"])
+print("\n".join("%s %d" % count for count in sorted(counts.items())))' < output/trace-test.json |
+        diff custom_output/trace-2-input_10 -
+done
+rm -f output/trace-test.json
+
+# Everything again with the threads run as coroutines (make coro, built with $CFLAGS if set)
+if [ -z "$PROJ1" ]; then
+    echo "Testing the coroutine build"
+    make -s coro OUT=proj1_coro CFLAGS="${CFLAGS:--std=gnu11}" && PROJ1=./proj1_coro "$0"
+    rm -f proj1_coro
+fi
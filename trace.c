@@ -0,0 +1,156 @@
+#include <stdarg.h>
+#include <errno.h>
+
+#include "scheduler.h"
+
+static FILE *trace_file;
+static bool trace_first;            // No event written yet, so no separator is needed
+static mutex_t trace_mutex; // Events come from both the clock and threads in P
+
+// CPU slice being extended while the same thread keeps running
+static int slice_tid = -1;  // Task id, which outlives the slot in online mode
+static int slice_start;
+static int slice_end;
+
+// Write one event, separated from the previous one
+static void trace_event(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    mutex_lock(&trace_mutex);
+    fputs(trace_first ? "\n" : ",\n", trace_file);
+    trace_first = false;
+    vfprintf(trace_file, format, args);
+    mutex_unlock(&trace_mutex);
+    va_end(args);
+}
+
+static void flush_slice()
+{
+    if (slice_tid == -1)
+    {
+        return;
+    }
+    // On the CPU track, and on the thread's own track
+    trace_event("{\"name\":\"T%d\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":%lld,\"dur\":%lld}",
+                slice_tid, slice_start * TRACE_US_PER_TICK, (slice_end - slice_start) * TRACE_US_PER_TICK);
+    trace_event("{\"name\":\"CPU\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%lld,\"dur\":%lld}",
+                slice_tid, slice_start * TRACE_US_PER_TICK, (slice_end - slice_start) * TRACE_US_PER_TICK);
+    slice_tid = -1;
+}
+
+// Start writing the trace to file_name
+int open_trace(char *file_name)
+{
+    trace_file = fopen(file_name, "w");
+    if (trace_file == NULL)
+    {
+        perror("fopen() error");
+        return -errno;
+    }
+    mutex_init(&trace_mutex);
+    prof_register(&trace_mutex, sizeof(mutex_t), 1, "trace_mutex", false);
+    trace_first = true;
+    slice_tid = -1;
+
+    fprintf(trace_file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    trace_event("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"CPU\"}}");
+    trace_event("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"CPU\"}}");
+    trace_event("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Threads\"}}");
+    if (!online)
+    {
+        for (int i = 0; i < num_threads; i++)
+        {
+            trace_thread(i);
+        }
+    }
+    return 0;
+}
+
+// Name the track of the task in slot tid (online tasks are named when they are admitted)
+void trace_thread(int tid)
+{
+    if (trace_file == NULL)
+    {
+        return;
+    }
+    trace_event("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"T%d\"}}",
+                task_id[tid], task_id[tid]);
+}
+
+// Finish the trace once every thread has ended
+void close_trace()
+{
+    if (trace_file == NULL)
+    {
+        return;
+    }
+    flush_slice();
+    fprintf(trace_file, "\n]}\n");
+    fclose(trace_file);
+    trace_file = NULL;
+}
+
+// tid ran on the CPU from time - 1 to time
+void trace_cpu(int tid, int time)
+{
+    if (trace_file == NULL)
+    {
+        return;
+    }
+    tid = task_id[tid];
+    if (tid == slice_tid && time - 1 == slice_end)
+    {
+        slice_end = time;
+        return;
+    }
+    flush_slice();
+    slice_tid = tid;
+    slice_start = time - 1;
+    slice_end = time;
+}
+
+// The CPU switches to tid for ticks ticks from time
+void trace_switch(int tid, int time, int ticks)
+{
+    if (trace_file == NULL)
+    {
+        return;
+    }
+    flush_slice();
+    trace_event("{\"name\":\"switch to T%d\",\"cat\":\"switch\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":%lld,\"dur\":%lld}",
+                task_id[tid], time * TRACE_US_PER_TICK, ticks * TRACE_US_PER_TICK);
+}
+
+// tid had the I/O device from start to end
+void trace_io(int tid, double start, double end)
+{
+    if (trace_file == NULL)
+    {
+        return;
+    }
+    trace_event("{\"name\":\"IO\",\"cat\":\"io\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.0f,\"dur\":%.0f}",
+                task_id[tid], start * TRACE_US_PER_TICK, (end - start) * TRACE_US_PER_TICK);
+}
+
+// tid was blocked in P on sem_id from start to end
+void trace_semaphore(int tid, int sem_id, double start, double end)
+{
+    if (trace_file == NULL)
+    {
+        return;
+    }
+    trace_event("{\"name\":\"P%d\",\"cat\":\"semaphore\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.0f,\"dur\":%.0f}",
+                sem_id, task_id[tid], start * TRACE_US_PER_TICK, (end - start) * TRACE_US_PER_TICK);
+}
+
+// tid moved to MLFQ level at time
+void trace_level(int tid, int level, int time)
+{
+    if (trace_file == NULL)
+    {
+        return;
+    }
+    trace_event("{\"name\":\"MLFQ level T%d\",\"cat\":\"mlfq\",\"ph\":\"C\",\"pid\":1,\"ts\":%lld,\"args\":{\"level\":%d}}",
+                task_id[tid], time * TRACE_US_PER_TICK, level);
+}
@@ -0,0 +1,19 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+Export of the simulated timeline as Chrome trace-event JSON, which loads in Perfetto
+(ui.perfetto.dev) or chrome://tracing. One tick is shown as one millisecond. Events are
+written as they happen, so memory use does not grow with the length of the trace.
+Events are labelled with task ids from the input, not the slots tasks run in.
+*/
+#define TRACE_US_PER_TICK 1000LL // Long long, so timestamps past 2^31 us don't overflow
+
+void trace_thread(int tid);
+void trace_cpu(int tid, int time);
+void trace_switch(int tid, int time, int ticks);
+void trace_io(int tid, double start, double end);
+void trace_semaphore(int tid, int sem_id, double start, double end);
+void trace_level(int tid, int level, int time);
+
+#endif
@@ -0,0 +1,204 @@
+#include "scheduler.h"
+
+/*
+Hierarchical timing wheel of pending wakeups, laid out like the classic Linux timer wheel.
+Level 0 has one slot per tick for the next WHEEL_SIZE ticks, and each slot of level n
+covers WHEEL_SIZE^n ticks. A timer is added to the slot its expiry tick falls in, in O(1).
+When level 0 wraps around, the next slot of level 1 is cascaded: its timers are added again,
+now landing in level 0, and so on up the levels. Timers beyond the last level wait in the
+overflow list until the last level wraps.
+Only worker_mutex holders use the wheel: threads in wait_until_turn, and the global clock.
+*/
+
+static void slot_append(struct wheel_slot *slot, struct wheel_timer *timer)
+{
+    timer->next = NULL;
+    if (slot->tail == NULL)
+    {
+        slot->head = timer;
+    }
+    else
+    {
+        slot->tail->next = timer;
+    }
+    slot->tail = timer;
+}
+
+// Take every timer out of a slot, in order
+static struct wheel_timer *slot_take(struct wheel_slot *slot)
+{
+    struct wheel_timer *timers = slot->head;
+    slot->head = NULL;
+    slot->tail = NULL;
+    return timers;
+}
+
+// Put a timer in the slot its expiry falls in, relative to the next tick to run
+static void wheel_insert(struct timer_wheel *wheel, struct wheel_timer *timer)
+{
+    long delta = timer->expires - wheel->next;
+    if (delta < 0)
+    {
+        // Already due, expire it with the next tick
+        slot_append(&wheel->slots[0][wheel->next & WHEEL_MASK], timer);
+        return;
+    }
+    for (int level = 0; level < WHEEL_LEVELS; level++)
+    {
+        if (delta < 1L << (WHEEL_BITS * (level + 1)))
+        {
+            int index = (timer->expires >> (WHEEL_BITS * level)) & WHEEL_MASK;
+            slot_append(&wheel->slots[level][index], timer);
+            return;
+        }
+    }
+    slot_append(&wheel->overflow, timer);
+}
+
+// Add the timers of one slot again, which moves them down a level. Returns the slot index
+static int cascade(struct timer_wheel *wheel, int level)
+{
+    int index = (wheel->next >> (WHEEL_BITS * level)) & WHEEL_MASK;
+    struct wheel_timer *timer = slot_take(&wheel->slots[level][index]);
+    while (timer != NULL)
+    {
+        struct wheel_timer *next = timer->next;
+        wheel_insert(wheel, timer);
+        timer = next;
+    }
+    return index;
+}
+
+static int compare_timers(const void *a, const void *b)
+{
+    const struct wheel_timer *x = *(struct wheel_timer *const *)a;
+    const struct wheel_timer *y = *(struct wheel_timer *const *)b;
+    if (x->time != y->time)
+    {
+        return x->time < y->time ? -1 : 1;
+    }
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+// initialize a timing wheel whose next tick to run is now
+void init_wheel(struct timer_wheel *wheel, long now)
+{
+    for (int level = 0; level < WHEEL_LEVELS; level++)
+    {
+        for (int i = 0; i < WHEEL_SIZE; i++)
+        {
+            slot_take(&wheel->slots[level][i]);
+        }
+    }
+    slot_take(&wheel->overflow);
+    wheel->next = now;
+    wheel->seq = 0;
+}
+
+// Wake tid at time, which is after the current tick
+void wheel_add(struct timer_wheel *wheel, int tid, float time)
+{
+    struct wheel_timer *timer = (struct wheel_timer *)malloc(sizeof(struct wheel_timer));
+    timer->time = time;
+    // First tick at or after time, compared as floats like the clock does (ticks past 2^24 round)
+    timer->expires = (long)ceil(time);
+    while ((float)(timer->expires - 1) >= time)
+    {
+        timer->expires--;
+    }
+    timer->tid = tid;
+    timer->seq = wheel->seq++;
+    wheel_insert(wheel, timer);
+}
+
+// Run the wheel up to tick, pushing the threads due by then to the due queue in order of
+// time, and in the order they were added for equal times
+void wheel_advance(struct timer_wheel *wheel, long tick, struct priority_queue *due)
+{
+    struct wheel_slot expired = {NULL, NULL};
+    int count = 0;
+
+    while (wheel->next <= tick)
+    {
+        // Cascade from the level above whenever a level wraps around
+        int level = 0;
+        while (level < WHEEL_LEVELS - 1 && ((wheel->next >> (WHEEL_BITS * level)) & WHEEL_MASK) == 0)
+        {
+            level++;
+            if (cascade(wheel, level) != 0)
+            {
+                break;
+            }
+            if (level == WHEEL_LEVELS - 1)
+            {
+                // Last level wrapped, so overflow timers may now fit
+                struct wheel_timer *timer = slot_take(&wheel->overflow);
+                while (timer != NULL)
+                {
+                    struct wheel_timer *next = timer->next;
+                    wheel_insert(wheel, timer);
+                    timer = next;
+                }
+            }
+        }
+
+        struct wheel_timer *timer = slot_take(&wheel->slots[0][wheel->next & WHEEL_MASK]);
+        while (timer != NULL)
+        {
+            struct wheel_timer *next = timer->next;
+            slot_append(&expired, timer);
+            count++;
+            timer = next;
+        }
+        wheel->next++;
+    }
+    if (count == 0)
+    {
+        return;
+    }
+
+    // Timers in a slot are only in time order within each cascade, so sort them
+    struct wheel_timer **timers = (struct wheel_timer **)malloc(sizeof(struct wheel_timer *) * count);
+    struct wheel_timer *timer = expired.head;
+    for (int i = 0; i < count; i++)
+    {
+        timers[i] = timer;
+        timer = timer->next;
+    }
+    qsort(timers, count, sizeof(struct wheel_timer *), compare_timers);
+    for (int i = 0; i < count; i++)
+    {
+        push(due, timers[i]->tid, timers[i]->time, 0.0);
+        free(timers[i]);
+    }
+    free(timers);
+}
+
+static bool slot_find(struct wheel_slot *slot, int tid, float *time)
+{
+    for (struct wheel_timer *timer = slot->head; timer != NULL; timer = timer->next)
+    {
+        if (timer->tid == tid)
+        {
+            *time = timer->time;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Check whether tid has a pending timer, and get its time (only used by checkpoints)
+bool wheel_find(struct timer_wheel *wheel, int tid, float *time)
+{
+    for (int level = 0; level < WHEEL_LEVELS; level++)
+    {
+        for (int i = 0; i < WHEEL_SIZE; i++)
+        {
+            if (slot_find(&wheel->slots[level][i], tid, time))
+            {
+                return true;
+            }
+        }
+    }
+    return slot_find(&wheel->overflow, tid, time);
+}